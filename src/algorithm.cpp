@@ -0,0 +1,98 @@
+#include "algorithm.h"
+
+#include <format>
+
+namespace
+{
+	std::string get_coords(uint64_t x, uint64_t y) { return std::format("({}, {})", x, y); }
+}
+
+void generate(maze &m, algorithm_type algorithm)
+{
+	switch (algorithm)
+	{
+	case algorithm_type::recursive_backtracker:
+		m.gen_recursive_backtracker();
+		break;
+	case algorithm_type::parallel_backtracker:
+		m.gen_parallel_backtracker();
+		break;
+	case algorithm_type::wilsons:
+		m.gen_wilsons();
+		break;
+	case algorithm_type::parallel_wilsons:
+		m.gen_parallel_wilsons();
+		break;
+	case algorithm_type::recursive_division:
+		m.gen_recursive_division();
+		break;
+	case algorithm_type::kruskals:
+		m.gen_kruskals();
+		break;
+	case algorithm_type::ellers:
+		m.gen_ellers();
+		break;
+	}
+}
+
+const char *get_algorithm_name(algorithm_type algorithm)
+{
+	switch (algorithm)
+	{
+	case algorithm_type::recursive_backtracker:
+		return "Recursive Backtracker";
+	case algorithm_type::parallel_backtracker:
+		return "Parallel Recursive Backtracker";
+	case algorithm_type::wilsons:
+		return "Wilson's Algorithm";
+	case algorithm_type::parallel_wilsons:
+		return "Parallel Wilson's Algorithm";
+	case algorithm_type::recursive_division:
+		return "Recursive Division";
+	case algorithm_type::kruskals:
+		return "Kruskal's Algorithm";
+	case algorithm_type::ellers:
+		return "Eller's Algorithm";
+	}
+	return "";
+}
+
+const char *get_difficulty_name(double difficulty)
+{
+	// choices for range are not arbitrary, and have been statistically calculated
+	if (difficulty < 2)
+		return "Ridiculously Easy";
+	else if (difficulty < 2.5)
+		return "Easy";
+	else if (difficulty < 3)
+		return "Medium Difficulty";
+	else if (difficulty < 3.5)
+		return "Hard";
+	else if (difficulty < 5.0)
+		return "Ridiculously Hard";
+	else if (difficulty < 15.0)
+		return "Humanly Impossible";
+	else
+		return "Computer will struggle";
+}
+
+std::vector<std::pair<std::string, std::string>> get_text_chunks(uint_least32_t seed, uint64_t maze_width, uint64_t maze_height, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, pt entrance, pt exit, algorithm_type algorithm, bool analysed, double difficulty, maze::len_t solution_branch_count, maze::len_t solution_distance)
+{
+	std::vector<std::pair<std::string, std::string>> chunks = {
+		std::pair<std::string, std::string>{"Author", "Generated by program mkmz created by JC Squires"},
+		std::pair<std::string, std::string>{"Maze Seed", std::to_string(seed)},
+		std::pair<std::string, std::string>{"Maze Dimensions", get_coords(maze_width, maze_height)},
+		std::pair<std::string, std::string>{"Cell Dimensions", get_coords(cell_width, cell_height)},
+		std::pair<std::string, std::string>{"Wall Width", std::to_string(wall_width)},
+		std::pair<std::string, std::string>{"Maze Entrance", get_coords(entrance.x, entrance.y)},
+		std::pair<std::string, std::string>{"Maze Exit", get_coords(exit.x, exit.y)},
+		std::pair<std::string, std::string>{"Maze Generation Algorithm", get_algorithm_name(algorithm)},
+	};
+	if (analysed)
+	{
+		chunks.emplace_back("Maze difficulty", std::to_string(difficulty) + " (" + get_difficulty_name(difficulty) + ')');
+		chunks.emplace_back("Solution Branch Count", std::to_string(solution_branch_count));
+		chunks.emplace_back("Solution Distance", std::to_string(solution_distance));
+	}
+	return chunks;
+}
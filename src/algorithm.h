@@ -0,0 +1,27 @@
+#pragma once
+#include "maze.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// generation algorithms that can be picked from the command line or a request
+enum class algorithm_type
+{
+    recursive_backtracker,
+    parallel_backtracker,
+    wilsons,
+    parallel_wilsons,
+    recursive_division,
+    kruskals,
+    ellers,
+};
+
+// makes a maze in m with algorithm, using m's dimensions, seed, layout and pool
+void generate(maze &m, algorithm_type algorithm);
+const char *get_algorithm_name(algorithm_type algorithm);
+const char *get_difficulty_name(double difficulty);
+
+// text chunks describing a maze, written into its png
+// difficulty, branch count and distance are left out if the maze wasn't analysed
+std::vector<std::pair<std::string, std::string>> get_text_chunks(uint_least32_t seed, uint64_t maze_width, uint64_t maze_height, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, pt entrance, pt exit, algorithm_type algorithm, bool analysed, double difficulty, maze::len_t solution_branch_count, maze::len_t solution_distance);
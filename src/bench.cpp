@@ -0,0 +1,385 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <vector>
+
+#include "maze.h"
+#include "image.h"
+#include "render.h"
+#include "thread_pool.h"
+#include "mapped.h"
+
+#include <format>
+
+// times every stage of making a maze image on its own, over a matrix of maze sizes, cell and wall dimensions and color types
+// results are printed and written as json, so they can be compared between builds
+
+namespace
+{
+	constexpr std::uint_least32_t seed = 1;
+
+	struct generator
+	{
+		const char *name;
+		void (maze::*gen)();
+		// serial generator a parallel one is compared against, which comes before it, or null
+		const char *serial;
+	};
+
+	constexpr generator generators[] = {
+		{"recursive_backtracker", &maze::gen_recursive_backtracker, nullptr},
+		{"parallel_backtracker", &maze::gen_parallel_backtracker, "recursive_backtracker"},
+		{"wilsons", &maze::gen_wilsons, nullptr},
+		{"parallel_wilsons", &maze::gen_parallel_wilsons, "wilsons"},
+		{"recursive_division", &maze::gen_recursive_division, nullptr},
+		{"kruskals", &maze::gen_kruskals, nullptr},
+		{"ellers", &maze::gen_ellers, nullptr},
+	};
+
+	struct dims
+	{
+		std::uint64_t cell_width, cell_height, wall_width;
+	};
+
+	struct color_format
+	{
+		const char *name;
+		int depth;
+		color_t col;
+		std::uint16_t wall[4], cell[4];
+	};
+
+	constexpr color_format color_formats[] = {
+		{"gray1", 1, color_t::gray, {0}, {1}},
+		{"gray8", 8, color_t::gray, {20}, {230}},
+		{"gray_alpha", 8, color_t::gray_alpha, {20, 255}, {230, 128}},
+		{"rgb", 8, color_t::rgb, {20, 40, 60}, {230, 220, 210}},
+		{"rgba", 8, color_t::rgba, {20, 40, 60, 255}, {230, 220, 210, 128}},
+	};
+
+	// best time of reps runs of fun, in seconds
+	template <typename F>
+	double best_of(unsigned int reps, F &&fun)
+	{
+		double best = 0;
+		for (unsigned int i = 0; i < reps; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			fun();
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (!i || elapsed < best)
+				best = elapsed;
+		}
+		return best;
+	}
+
+	// bytes the pixels of an image take up unpacked, the same for every stage so they can be compared
+	std::uint64_t pixel_bytes(const image &img)
+	{
+		return img.height() * ((img.width() * img.depth() * static_cast<std::uint64_t>(img.color()) + 7) / 8);
+	}
+
+	std::string rate(double per_second)
+	{
+		if (per_second >= 1e9)
+			return std::format("{:.2f}G", per_second / 1e9);
+		if (per_second >= 1e6)
+			return std::format("{:.2f}M", per_second / 1e6);
+		return std::format("{:.2f}K", per_second / 1e3);
+	}
+
+	void process_args(int argc, char *argv[], std::string &output, std::vector<unsigned int> &thread_counts, unsigned int &reps, bool &quick, maze::layout &layout, std::string &mmap_dir);
+}
+
+int main(int argc, char *argv[])
+{
+	std::string output;
+	// generators and find_exits are timed with every count, from lowest to highest, drawing and writing with the highest
+	std::vector<unsigned int> thread_counts;
+	unsigned int reps;
+	bool quick;
+	maze::layout layout;
+	// directory for memory mapped maze storage, empty if mazes are kept in ram
+	std::string mmap_dir;
+
+	process_args(argc, argv, output, thread_counts, reps, quick, layout, mmap_dir);
+
+	mapped::set_directory(mmap_dir);
+	const char *mmap_json = mmap_dir.empty() ? "false" : "true";
+
+	const char *layout_name = layout == maze::layout::tiled ? "tiled" : "row_major";
+
+	thread_pool pool(thread_counts.back());
+
+	std::vector<maze::len_t> gen_sizes = quick ? std::vector<maze::len_t>{256} : std::vector<maze::len_t>{512, 2048};
+	// only buffers of at least mapped::min_size bytes are mapped, and 8192x8192 is the smallest square maze whose cells are that big
+	if (!mmap_dir.empty() && !quick)
+		gen_sizes.push_back(8192);
+	std::vector<maze::len_t> draw_sizes = quick ? std::vector<maze::len_t>{128} : std::vector<maze::len_t>{256, 1024};
+	std::vector<dims> draw_dims = {{1, 1, 1}, {4, 4, 2}};
+
+	std::cout << "Using " << pool.size() << " thread";
+	if (pool.size() != 1)
+		std::cout << 's';
+	if (thread_counts.size() > 1)
+	{
+		std::cout << ", generating with";
+		for (unsigned int threads : thread_counts)
+			std::cout << ' ' << threads;
+	}
+	std::cout << ", best of " << reps << ", " << layout_name << " layout";
+	if (!mmap_dir.empty())
+		std::cout << ", mazes mapped in " << mmap_dir;
+	std::cout << ".\n";
+
+	// json objects of every result
+	std::vector<std::string> results;
+
+	for (maze::len_t size : gen_sizes)
+	{
+		double cells = static_cast<double>(size * size);
+
+		// best times by generator and thread count, to work out the speedups
+		std::map<std::pair<std::string, unsigned int>, double> times;
+
+		for (unsigned int threads : thread_counts)
+		{
+			thread_pool gen_pool(threads);
+
+			// json fields and text of how much faster than name with fewer threads, or serial with as many, seconds is
+			auto speedups = [&](const std::string &name, const char *serial, double seconds, std::string &json, std::string &text) {
+				if (threads != thread_counts.front())
+				{
+					double speedup = times[{name, thread_counts.front()}] / seconds;
+					json += std::format(R"(, "speedup": {:.3f})", speedup);
+					text += std::format(", {:.2f}x {} thread{}", speedup, thread_counts.front(), thread_counts.front() != 1 ? "s" : "");
+				}
+				if (serial)
+				{
+					double speedup = times[{serial, threads}] / seconds;
+					json += std::format(R"(, "serial_algorithm": "{}", "speedup_vs_serial": {:.3f})", serial, speedup);
+					text += std::format(", {:.2f}x {}", speedup, serial);
+				}
+				times[{name, threads}] = seconds;
+			};
+
+			// the generators analyse the maze once it's made, so find_exits is timed on its own to tell the two apart
+			for (const generator &g : generators)
+			{
+				maze mz(size, size);
+				mz.set_seed(seed);
+				mz.set_layout(layout);
+				mz.set_thread_pool(&gen_pool);
+
+				double seconds = best_of(reps, [&] { (mz.*g.gen)(); });
+
+				std::string json, text;
+				speedups(g.name, g.serial, seconds, json, text);
+
+				std::cout << std::format("generate {:<22} {}x{} {:>3}t: {:.4f}s, {} cells/s{}\n", g.name, size, size, threads, seconds, rate(cells / seconds), text);
+				results.push_back(std::format(R"({{"stage": "generate", "algorithm": "{}", "maze_width": {}, "maze_height": {}, "layout": "{}", "mmap": {}, "threads": {}, "seconds": {:.6f}, "cells_per_second": {:.0f}{}}})",
+											  g.name, size, size, layout_name, mmap_json, threads, seconds, cells / seconds, json));
+			}
+
+			maze mz(size, size);
+			mz.set_seed(seed);
+			mz.set_layout(layout);
+			mz.set_thread_pool(&gen_pool);
+			mz.gen_recursive_backtracker();
+
+			double seconds = best_of(reps, [&] { mz.find_exits(); });
+
+			std::string json, text;
+			speedups("find_exits", nullptr, seconds, json, text);
+
+			std::cout << std::format("find_exits {:<20} {}x{} {:>3}t: {:.4f}s, {} cells/s{}\n", "", size, size, threads, seconds, rate(cells / seconds), text);
+			results.push_back(std::format(R"({{"stage": "find_exits", "maze_width": {}, "maze_height": {}, "layout": "{}", "mmap": {}, "threads": {}, "seconds": {:.6f}, "cells_per_second": {:.0f}{}}})",
+										  size, size, layout_name, mmap_json, threads, seconds, cells / seconds, json));
+		}
+	}
+
+	std::filesystem::path png_path = std::filesystem::temp_directory_path() / std::format("mkmz_bench_{}.png", std::time(nullptr));
+
+	for (maze::len_t size : draw_sizes)
+	{
+		maze mz(size, size);
+		mz.set_seed(seed);
+		mz.set_layout(layout);
+		mz.set_thread_pool(&pool);
+		mz.gen_recursive_backtracker();
+
+		double cells = static_cast<double>(size * size);
+
+		for (const dims &d : draw_dims)
+			for (const color_format &f : color_formats)
+			{
+				maze_renderer renderer(mz, d.cell_width, d.cell_height, d.wall_width, f.wall, f.cell, f.depth, f.col);
+				image img(renderer.width(), renderer.height(), f.depth, f.col);
+
+				std::string config = std::format(R"("maze_width": {}, "maze_height": {}, "layout": "{}", "cell_width": {}, "cell_height": {}, "wall_width": {}, "color": "{}", "image_width": {}, "image_height": {})",
+												 size, size, layout_name, d.cell_width, d.cell_height, d.wall_width, f.name, img.width(), img.height());
+				std::string label = std::format("{}x{} c{}x{} w{} {}", size, size, d.cell_width, d.cell_height, d.wall_width, f.name);
+
+				double bytes = static_cast<double>(pixel_bytes(img));
+
+				double seconds = best_of(reps, [&] { render_image(renderer, img, pool); });
+
+				std::cout << std::format("draw_image {:<30}: {:.4f}s, {} cells/s, {}B/s\n", label, seconds, rate(cells / seconds), rate(bytes / seconds));
+				results.push_back(std::format(R"({{"stage": "draw_image", {}, "seconds": {:.6f}, "cells_per_second": {:.0f}, "bytes_per_second": {:.0f}}})",
+											  config, seconds, cells / seconds, bytes / seconds));
+
+				seconds = best_of(reps, [&] { img.write(png_path.string(), {}, 4, {}, &pool); });
+				std::uintmax_t file_bytes = std::filesystem::file_size(png_path);
+
+				std::cout << std::format("write      {:<30}: {:.4f}s, {} cells/s, {}B/s\n", label, seconds, rate(cells / seconds), rate(bytes / seconds));
+				results.push_back(std::format(R"({{"stage": "write", {}, "seconds": {:.6f}, "cells_per_second": {:.0f}, "bytes_per_second": {:.0f}, "file_bytes": {}}})",
+											  config, seconds, cells / seconds, bytes / seconds, file_bytes));
+			}
+	}
+
+	std::filesystem::remove(png_path);
+
+	char timestamp[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	std::ofstream file(output);
+	if (!file)
+	{
+		std::cout << "Couldn't open " << output << " for writing\n";
+		return 1;
+	}
+
+	file << "{\n";
+	file << "  \"timestamp\": \"" << timestamp << "\",\n";
+	file << "  \"threads\": " << pool.size() << ",\n";
+	file << "  \"generate_threads\": [";
+	for (std::size_t i = 0; i < thread_counts.size(); ++i)
+		file << (i ? ", " : "") << thread_counts[i];
+	file << "],\n";
+	file << "  \"reps\": " << reps << ",\n";
+	file << "  \"seed\": " << seed << ",\n";
+	file << "  \"layout\": \"" << layout_name << "\",\n";
+	file << "  \"mmap\": " << mmap_json << ",\n";
+	file << "  \"results\": [\n";
+	for (std::size_t i = 0; i < results.size(); ++i)
+		file << "    " << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+	file << "  ]\n";
+	file << "}\n";
+
+	std::cout << "Results written to " << output << '\n';
+
+	return 0;
+}
+
+namespace
+{
+	bool try_conversion(const char *str, unsigned long long &res)
+	{
+		try
+		{
+			res = std::stoull(str);
+		}
+		catch (...)
+		{
+			return false;
+		}
+		return true;
+	}
+
+	void process_args(int argc, char *argv[], std::string &output, std::vector<unsigned int> &thread_counts, unsigned int &reps, bool &quick, maze::layout &layout, std::string &mmap_dir)
+	{
+		output = "mkmz_bench.json";
+		// 1 thread as well as every core, so the parallel generators' scaling is reported
+		unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+		thread_counts = cores > 1 ? std::vector<unsigned int>{1, cores} : std::vector<unsigned int>{1};
+		reps = 3;
+		quick = false;
+		layout = maze::layout::row_major;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			unsigned long long res;
+
+			if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+			{
+				std::cout << "Usage: mkmz_bench [OPTIONS]\n"
+							 "Options:\n"
+							 "    -o [FILE]                                 Writes the results as json to FILE (Defaults to mkmz_bench.json)\n"
+							 "    -threads [THREADS,...]                    Sets the numbers of threads to generate with, and draws and writes with the highest (Defaults to \"1,[CORES]\")\n"
+							 "    -reps [REPS]                              Runs every benchmark REPS times and keeps the best time (Defaults to 3)\n"
+							 "    --quick                                   Only benchmarks small mazes, to check that everything runs\n"
+							 "    --tiled                                   Stores the mazes in square tiles, like mkmz --tiled\n"
+							 "    -mmap [DIRECTORY]                         Keeps the mazes in memory mapped files in DIRECTORY, like mkmz -mmap, and adds 8192x8192 mazes, the smallest that are mapped\n";
+				std::exit(0);
+			}
+			else if (strcmp(argv[i], "-o") == 0)
+			{
+				if (i + 1 == argc)
+				{
+					std::cout << "Value for -o missing, ignoring...\n";
+					continue;
+				}
+				output = argv[++i];
+			}
+			else if (strcmp(argv[i], "-threads") == 0)
+			{
+				std::vector<unsigned int> counts;
+				bool valid = i + 1 < argc;
+				for (std::string list = valid ? argv[i + 1] : ""; valid && !list.empty();)
+				{
+					auto comma = list.find(',');
+					valid = try_conversion(list.substr(0, comma).c_str(), res) && res != 0;
+					counts.push_back(static_cast<unsigned int>(res));
+					list = comma == std::string::npos ? "" : list.substr(comma + 1);
+				}
+				if (!valid || counts.empty())
+				{
+					std::cout << "Value for -threads missing or incorrectly formatted, ignoring...\n";
+					continue;
+				}
+				++i;
+
+				std::sort(counts.begin(), counts.end());
+				counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+				thread_counts = std::move(counts);
+			}
+			else if (strcmp(argv[i], "-reps") == 0)
+			{
+				if (i + 1 == argc || !try_conversion(argv[i + 1], res) || res == 0)
+				{
+					std::cout << "Value for -reps missing or incorrectly formatted, ignoring...\n";
+					continue;
+				}
+				++i;
+				reps = static_cast<unsigned int>(res);
+			}
+			else if (strcmp(argv[i], "--quick") == 0)
+				quick = true;
+			else if (strcmp(argv[i], "--tiled") == 0)
+				layout = maze::layout::tiled;
+			else if (strcmp(argv[i], "-mmap") == 0)
+			{
+				if (!mapped::supported())
+				{
+					std::cout << "Memory mapped storage isn't supported on this platform, ignoring -mmap...\n";
+					++i;
+					continue;
+				}
+				if (i + 1 == argc || !std::filesystem::is_directory(argv[i + 1]))
+				{
+					std::cout << "Value for -mmap missing or not a directory, ignoring...\n";
+					continue;
+				}
+				mmap_dir = argv[++i];
+			}
+			else
+				std::cout << "Ignoring unknown argument " << argv[i] << '\n';
+		}
+	}
+}
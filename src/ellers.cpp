@@ -0,0 +1,98 @@
+#include "ellers.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+ellers::ellers(len_t width, len_t height, std::uint_least32_t seed) :
+	m_width{width}, m_height{height},
+	m_row{},
+	m_gen(seed),
+	m_bits{}, m_bit_count{},
+	m_next(width), m_prev(width)
+{
+	// every cell starts on its own
+	for (len_t x = 0; x < width; ++x)
+		m_next[x] = m_prev[x] = x;
+}
+
+void ellers::join(len_t x)
+{
+	// x is the last cell of its list before x + 1, and x + 1's list fits between x and the cell after it
+	len_t after = m_next[x];
+	len_t last = m_prev[x + 1];
+
+	m_next[x] = x + 1;
+	m_prev[x + 1] = x;
+	m_next[last] = after;
+	m_prev[after] = last;
+}
+
+void ellers::split(len_t x)
+{
+	m_next[m_prev[x]] = m_next[x];
+	m_prev[m_next[x]] = m_prev[x];
+	m_next[x] = m_prev[x] = x;
+}
+
+void ellers::next(std::uint64_t *up, std::uint64_t *right)
+{
+	if (m_row >= m_height)
+		throw std::out_of_range("Row not in range");
+
+	len_t words = (m_width + 63) / 64;
+	std::fill(up, up + words, 0);
+	std::fill(right, right + words, 0);
+
+	// the last row joins everything that's still apart
+	bool last = m_row + 1 == m_height;
+
+	for (len_t x = 0; x + 1 < m_width; ++x)
+		if (m_next[x] != x + 1 && (last || coin()))
+		{
+			join(x);
+			right[x / 64] |= std::uint64_t{1} << (x % 64);
+		}
+
+	if (!last)
+	{
+		// cells that don't go up start on their own in the next row, but the last cell of a list always goes up so nothing gets cut off
+		for (len_t x = 0; x < m_width; ++x)
+		{
+			if (m_next[x] != x && coin())
+				split(x);
+			else
+				up[x / 64] |= std::uint64_t{1} << (x % 64);
+		}
+	}
+
+	++m_row;
+}
+
+ellers_window::ellers_window(len_t width, len_t height, std::uint_least32_t seed, len_t capacity) :
+	m_gen(width, height, seed),
+	m_capacity{std::max<len_t>(1, capacity)},
+	m_words{(width + 63) / 64},
+	m_rows(m_capacity * m_words * 2)
+{
+}
+
+void ellers_window::get_row(len_t y, std::uint64_t *up, std::uint64_t *right)
+{
+	if (y >= m_gen.height())
+		throw std::out_of_range("Row not in range");
+
+	const std::lock_guard lock(m_lock);
+
+	while (m_gen.row() <= y)
+	{
+		std::uint64_t *slot = m_rows.data() + (m_gen.row() % m_capacity) * m_words * 2;
+		m_gen.next(slot, slot + m_words);
+	}
+
+	if (y + m_capacity < m_gen.row())
+		throw std::runtime_error("Row was dropped from the window");
+
+	const std::uint64_t *slot = m_rows.data() + (y % m_capacity) * m_words * 2;
+	std::copy(slot, slot + m_words, up);
+	std::copy(slot + m_words, slot + m_words * 2, right);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "maze.h"
+
+#include <mutex>
+#include <random>
+#include <vector>
+
+// eller's algorithm, makes a maze one row at a time from y = 0 up while only remembering the row it's on
+// memory only grows with the width, so there's no limit on the height
+class ellers
+{
+public:
+    using len_t = maze::len_t;
+
+    ellers(len_t width, len_t height, std::uint_least32_t seed);
+
+    inline len_t width() const { return m_width; }
+    inline len_t height() const { return m_height; }
+
+    // row the next call to next() makes
+    inline len_t row() const { return m_row; }
+
+    /// @brief makes the next row, in the same format as maze::get_row
+    /// @param up receives one bit per cell, set if the wall above the cell is open, must hold (width + 63) / 64 words
+    /// @param right receives one bit per cell, set if the wall right of the cell is open, must hold (width + 63) / 64 words
+    void next(std::uint64_t *up, std::uint64_t *right);
+
+private:
+    len_t m_width, m_height;
+    len_t m_row;
+
+    std::mt19937 m_gen;
+    // random bits not used yet
+    std::uint32_t m_bits;
+    unsigned int m_bit_count;
+
+    // cells connected by the rows made so far form a circular list in order of x, so cells x and x + 1 are connected if m_next[x] == x + 1
+    // the paths below a row can't cross, so merging two lists keeps them in order
+    std::vector<len_t> m_next;
+    std::vector<len_t> m_prev;
+
+    inline bool coin()
+    {
+        if (!m_bit_count)
+        {
+            m_bits = static_cast<std::uint32_t>(m_gen());
+            m_bit_count = 32;
+        }
+        bool res = m_bits & 1;
+        m_bits >>= 1;
+        --m_bit_count;
+        return res;
+    }
+
+    // joins the lists of x and x + 1
+    void join(len_t x);
+    // takes x out of its list
+    void split(len_t x);
+};
+
+// keeps the newest rows an ellers generator made, so they can be read a bit out of order and more than once
+// rows are made as they're asked for, rows more than capacity behind the newest one are gone
+// safe to use from multiple threads
+class ellers_window
+{
+public:
+    using len_t = maze::len_t;
+
+    ellers_window(len_t width, len_t height, std::uint_least32_t seed, len_t capacity);
+
+    inline len_t width() const { return m_gen.width(); }
+    inline len_t height() const { return m_gen.height(); }
+
+    // same as maze::get_row
+    void get_row(len_t y, std::uint64_t *up, std::uint64_t *right);
+
+private:
+    std::mutex m_lock;
+    ellers m_gen;
+    len_t m_capacity;
+    len_t m_words;
+    // capacity rows of up words followed by right words, row y is in slot y % capacity
+    std::vector<std::uint64_t> m_rows;
+};
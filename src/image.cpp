@@ -1,16 +1,36 @@
 #include "image.h"
+#include "progress.h"
 
 #include <png.h>
+#include <zlib.h>
 #include <cstdio>
 
-#include <thread>
-#include <chrono>
-
 #include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef _WIN32
+	#include <io.h>
+#elif defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+	#define MKMZ_POSIX_IO 1
+	#include <cerrno>
+	#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+	// every x86-64 cpu has sse2
+	#define MKMZ_SSE2 1
+	#include <immintrin.h>
+	#if defined(__GNUC__)
+		// avx2 and avx-512 kernels are compiled alongside it and picked at runtime
+		#define MKMZ_X86_DISPATCH 1
+	#endif
+#endif
 
 bool image::within_limits(uint64_t width, uint64_t height)
 {
-	return height < PNG_USER_HEIGHT_MAX && width < PNG_USER_WIDTH_MAX;
+	return width && height && height <= PNG_UINT_31_MAX && width <= PNG_UINT_31_MAX;
 }
 
 image::image(uint64_t width, uint64_t height, int depth, color_t col) : m_width{width}, m_height{height}, m_depth{depth}, m_col{col}
@@ -20,11 +40,9 @@ image::image(uint64_t width, uint64_t height, int depth, color_t col) : m_width{
 	if (width > PNG_UINT_32_MAX / ((m_depth * static_cast<uint64_t>(m_col) + 7) / 8))
 		throw std::length_error("Image width exceeds limit");
 	assert_color_depth(col, depth);
-	row_locks = std::vector<std::mutex>(m_height);
-	m_data.resize(height);
-	auto len = row_len();
-	for (auto &row : m_data)
-		row.resize(len);
+	// 8 base_t's to a cache line
+	m_stride = (row_len() + 7) / 8 * 8;
+	m_data.resize(m_stride * height);
 }
 
 void error_fn(png_structp png_ptr, png_const_charp error_msg)
@@ -64,34 +82,60 @@ struct lib
 	}
 };
 
-// i think it should be passed by value, not 100% sure though
-void progress_thread_image(std::function<void(double)> callback, uint64_t &cur, uint64_t total)
+// gathers the small writes of libpng and of the chunk writer into big blocks for the sink
+class sink_writer
 {
-	using namespace std::chrono_literals;
+public:
+	static constexpr std::size_t block_size = 1 << 20;
+
+	explicit sink_writer(const image::png_sink &sink) : m_sink{sink}, m_buf{}, m_written{}
+	{
+		m_buf.reserve(block_size);
+	}
 
-	uint64_t last = -1;
+	void write(const unsigned char *data, std::size_t len)
+	{
+		m_written += len;
+		if (m_buf.size() + len > block_size)
+		{
+			flush();
+			// big writes, like whole idat chunks, aren't copied
+			if (len >= block_size)
+			{
+				m_sink(data, len);
+				return;
+			}
+		}
+		m_buf.insert(m_buf.end(), data, data + len);
+	}
 
-	do
+	void flush()
 	{
-		if (cur != last)
-			callback(static_cast<double>(cur) / total);
-		std::this_thread::sleep_for(100ms);
-	} while (cur != total);
+		if (m_buf.empty())
+			return;
+		m_sink(m_buf.data(), m_buf.size());
+		m_buf.clear();
+	}
 
-	callback(1.0);
-}
+	inline uint64_t written() const { return m_written; }
+
+private:
+	const image::png_sink &m_sink;
+	std::vector<unsigned char> m_buf;
+	uint64_t m_written;
+};
 
-void image::write(const std::string &name, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback) const
+void write_png(sink_writer &out, uint64_t width, uint64_t height, int depth, color_t col, const image::row_generator &gen, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback)
 {
 	lib l;
-	std::unique_ptr<FILE, decltype(&fclose)> file(fopen(name.data(), "wb"), fclose);
-	if (!file)
-		throw std::runtime_error("Could not open file for writing");
-
-	png_init_io(l.png_ptr, file.get());
+	png_set_write_fn(l.png_ptr, &out, [](png_structp png_ptr, png_bytep data, png_size_t len) {
+		static_cast<sink_writer *>(png_get_io_ptr(png_ptr))->write(data, len);
+	}, nullptr);
 	png_set_compression_level(l.png_ptr, compression_level);
+	// default user limits are meant for reading, and are much smaller than what png allows
+	png_set_user_limits(l.png_ptr, PNG_UINT_31_MAX, PNG_UINT_31_MAX);
 	int color_type;
-	switch (m_col)
+	switch (col)
 	{
 	case color_t::gray:
 		color_type = PNG_COLOR_TYPE_GRAY;
@@ -109,7 +153,7 @@ void image::write(const std::string &name, const std::vector<std::pair<std::stri
 		throw std::runtime_error("Invalid color type");
 	}
 
-	png_set_IHDR(l.png_ptr, l.info_ptr, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), m_depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_set_IHDR(l.png_ptr, l.info_ptr, static_cast<uint32_t>(width), static_cast<uint32_t>(height), depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
 	png_text text{};
 
@@ -126,35 +170,593 @@ void image::write(const std::string &name, const std::vector<std::pair<std::stri
 
 	png_write_info(l.png_ptr, l.info_ptr);
 
-	if (m_depth < 8)
+	if (depth < 8)
 		png_set_packswap(l.png_ptr);
 
-	uint64_t i = 0;
+	// only one row is ever kept in memory
+	std::vector<image::base_t> buf(image::row_len(width, depth, col));
 
-	std::jthread progress_task;
-	if (callback)
-		progress_task = std::jthread(progress_thread_image, callback, std::ref(i), m_height);
-	
-	for (; i < m_data.size(); ++i)
-		png_write_row(l.png_ptr, reinterpret_cast<png_const_bytep>(m_data[i].data()));
+	progress_reporter prog(std::move(callback), height);
+
+	for (uint64_t i = 0; i < height; ++i)
+	{
+		png_write_row(l.png_ptr, reinterpret_cast<png_const_bytep>(gen(i, buf.data())));
+		prog.add(1);
+	}
 
 	png_write_end(l.png_ptr, l.info_ptr);
+
+	out.flush();
+}
+
+void put_u32(unsigned char *out, uint32_t val)
+{
+	out[0] = static_cast<unsigned char>(val >> 24);
+	out[1] = static_cast<unsigned char>(val >> 16);
+	out[2] = static_cast<unsigned char>(val >> 8);
+	out[3] = static_cast<unsigned char>(val);
+}
+
+void write_chunk(sink_writer &out, const char *type, const unsigned char *data, uint32_t len)
+{
+	unsigned char header[8];
+	put_u32(header, len);
+	std::memcpy(header + 4, type, 4);
+
+	uint32_t crc = static_cast<uint32_t>(crc32(0, header + 4, 4));
+	if (len)
+		crc = static_cast<uint32_t>(crc32(crc, data, len));
+	unsigned char footer[4];
+	put_u32(footer, crc);
+
+	out.write(header, 8);
+	if (len)
+		out.write(data, len);
+	out.write(footer, 4);
+}
+
+// png stores pixels smaller than a byte starting from the most significant bit
+struct bit_reverse_table
+{
+	unsigned char table[256];
+
+	constexpr bit_reverse_table() : table{}
+	{
+		for (int i = 0; i < 256; ++i)
+			for (int b = 0; b < 8; ++b)
+				if (i & (1 << b))
+					table[i] |= 1 << (7 - b);
+	}
+};
+
+constexpr bit_reverse_table bit_reverse;
+
+// sum of the filtered bytes as signed values, the heuristic libpng uses to pick a filter
+uint64_t filter_cost(const unsigned char *data, uint64_t len)
+{
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < len; ++i)
+		sum += data[i] < 128 ? data[i] : 256 - data[i];
+	return sum;
+}
+
+unsigned char paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = std::abs(p - a);
+	int pb = std::abs(p - b);
+	int pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return static_cast<unsigned char>(a);
+	if (pb <= pc)
+		return static_cast<unsigned char>(b);
+	return static_cast<unsigned char>(c);
+}
+
+// writes the filter byte followed by the filtered row into out, prev is nullptr for the first row
+// scratch must hold 4 * row_bytes bytes
+void filter_row(const unsigned char *row, const unsigned char *prev, uint64_t row_bytes, uint64_t bpp, bool adaptive, unsigned char *out, unsigned char *scratch)
+{
+	if (!adaptive)
+	{
+		out[0] = 0;
+		std::memcpy(out + 1, row, row_bytes);
+		return;
+	}
+
+	unsigned char *sub = scratch;
+	unsigned char *up = scratch + row_bytes;
+	unsigned char *avg = scratch + 2 * row_bytes;
+	unsigned char *pae = scratch + 3 * row_bytes;
+
+	for (uint64_t i = 0; i < row_bytes; ++i)
+	{
+		int a = i >= bpp ? row[i - bpp] : 0;
+		int b = prev ? prev[i] : 0;
+		int c = prev && i >= bpp ? prev[i - bpp] : 0;
+		sub[i] = static_cast<unsigned char>(row[i] - a);
+		up[i] = static_cast<unsigned char>(row[i] - b);
+		avg[i] = static_cast<unsigned char>(row[i] - (a + b) / 2);
+		pae[i] = static_cast<unsigned char>(row[i] - paeth(a, b, c));
+	}
+
+	const unsigned char *best = row;
+	unsigned char best_type = 0;
+	uint64_t best_cost = filter_cost(row, row_bytes);
+
+	const unsigned char *candidates[] = {sub, up, avg, pae};
+	for (unsigned char type = 1; type <= 4; ++type)
+	{
+		uint64_t cost = filter_cost(candidates[type - 1], row_bytes);
+		if (cost < best_cost)
+		{
+			best_cost = cost;
+			best = candidates[type - 1];
+			best_type = type;
+		}
+	}
+
+	out[0] = best_type;
+	std::memcpy(out + 1, best, row_bytes);
+}
+
+// rows of an image, filtered and compressed independently of the others
+struct png_block
+{
+	uint64_t first_row, row_count;
+	// filter byte + filtered row for every row in the block
+	std::vector<unsigned char> filtered;
+	std::vector<unsigned char> compressed;
+	uLong adler;
+};
+
+// rows of one block, aims for about 1 MiB of input per block
+uint64_t png_block_rows(uint64_t width, int depth, color_t col)
+{
+	uint64_t row_bytes = (width * depth * static_cast<uint64_t>(col) + 7) / 8;
+	return std::max<uint64_t>(1, (1 << 20) / (row_bytes + 1));
 }
 
-#include <mutex>
+// blocks that are in memory at once
+uint64_t png_batch_size(const thread_pool &pool)
+{
+	return pool.size() * 2;
+}
+
+// pigz style encoder, every block is deflated on its own thread and ends on a byte boundary so the results can be concatenated
+void write_png_parallel(sink_writer &out, uint64_t width, uint64_t height, int depth, color_t col, const image::row_generator &gen, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback, thread_pool &pool)
+{
+	unsigned char color_type;
+	switch (col)
+	{
+	case color_t::gray:
+		color_type = PNG_COLOR_TYPE_GRAY;
+		break;
+	case color_t::gray_alpha:
+		color_type = PNG_COLOR_TYPE_GRAY_ALPHA;
+		break;
+	case color_t::rgb:
+		color_type = PNG_COLOR_TYPE_RGB;
+		break;
+	case color_t::rgba:
+		color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+		break;
+	default:
+		throw std::runtime_error("Invalid color type");
+	}
+
+	static constexpr unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+	out.write(signature, 8);
+
+	unsigned char ihdr[13];
+	put_u32(ihdr, static_cast<uint32_t>(width));
+	put_u32(ihdr + 4, static_cast<uint32_t>(height));
+	ihdr[8] = static_cast<unsigned char>(depth);
+	ihdr[9] = color_type;
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	write_chunk(out, "IHDR", ihdr, 13);
+
+	for (const auto &chunk : text_chunks)
+	{
+		std::string data = chunk.first;
+		data += '\0';
+		data += chunk.second;
+		write_chunk(out, "tEXt", reinterpret_cast<const unsigned char *>(data.data()), static_cast<uint32_t>(data.size()));
+	}
+
+	uint64_t channel_count = static_cast<uint64_t>(col);
+	uint64_t row_bytes = (width * depth * channel_count + 7) / 8;
+	uint64_t bpp = std::max<uint64_t>(1, depth * channel_count / 8);
+	// libpng doesn't filter images with pixels smaller than a byte either
+	bool adaptive = depth >= 8;
+	uint64_t len = image::row_len(width, depth, col);
+
+	uint64_t block_rows = png_block_rows(width, depth, col);
+	uint64_t block_count = (height + block_rows - 1) / block_rows;
+	uint64_t batch_size = png_batch_size(pool);
+
+	std::vector<png_block> blocks(std::min(batch_size, block_count));
+	// last bytes of the previous block, used as the dictionary for the next one so the blocks compress almost as well as a single stream
+	std::vector<unsigned char> dictionary;
+
+	uLong adler = adler32(0, nullptr, 0);
+
+	progress_reporter prog(std::move(callback), height, &pool);
+
+	for (uint64_t first_block = 0; first_block < block_count; first_block += batch_size)
+	{
+		uint64_t count = std::min(batch_size, block_count - first_block);
+
+		// filter
+		pool.parallel_for(0, count, 1, [&](uint64_t b, uint64_t) {
+			png_block &block = blocks[b];
+			block.first_row = (first_block + b) * block_rows;
+			block.row_count = std::min(block_rows, height - block.first_row);
+			block.filtered.resize(block.row_count * (row_bytes + 1));
+
+			std::vector<image::base_t> buf(len), prev_buf(len);
+			std::vector<unsigned char> row(row_bytes), prev(row_bytes), scratch(adaptive ? 4 * row_bytes : 0);
+
+			auto get_row = [&](uint64_t y, std::vector<image::base_t> &buf, std::vector<unsigned char> &out) {
+				const unsigned char *data = reinterpret_cast<const unsigned char *>(gen(y, buf.data()));
+				if (depth < 8)
+					for (uint64_t j = 0; j < row_bytes; ++j)
+						out[j] = bit_reverse.table[data[j]];
+				else
+					std::memcpy(out.data(), data, row_bytes);
+			};
+
+			// the row above the block is needed for filtering
+			if (adaptive && block.first_row)
+				get_row(block.first_row - 1, prev_buf, prev);
+
+			for (uint64_t r = 0; r < block.row_count; ++r)
+			{
+				uint64_t y = block.first_row + r;
+				get_row(y, buf, row);
+				filter_row(row.data(), adaptive && y ? prev.data() : nullptr, row_bytes, bpp, adaptive, block.filtered.data() + r * (row_bytes + 1), scratch.data());
+				std::swap(row, prev);
+			}
+		});
+
+		// compress
+		pool.parallel_for(0, count, 1, [&](uint64_t b, uint64_t) {
+			png_block &block = blocks[b];
+			bool last = first_block + b + 1 == block_count;
+
+			const unsigned char *dict = nullptr;
+			uInt dict_len = 0;
+			if (b)
+			{
+				auto &prev = blocks[b - 1].filtered;
+				dict_len = static_cast<uInt>(std::min<std::size_t>(prev.size(), 32768));
+				dict = prev.data() + prev.size() - dict_len;
+			}
+			else if (!dictionary.empty())
+			{
+				dict = dictionary.data();
+				dict_len = static_cast<uInt>(dictionary.size());
+			}
+
+			z_stream stream{};
+			if (deflateInit2(&stream, compression_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+				throw std::runtime_error("Could not initialize zlib");
+			std::unique_ptr<z_stream, decltype(&deflateEnd)> guard(&stream, deflateEnd);
+
+			if (dict_len && deflateSetDictionary(&stream, dict, dict_len) != Z_OK)
+				throw std::runtime_error("Could not set zlib dictionary");
+
+			// zlib counts in 32 bits, so huge blocks are fed in pieces
+			static constexpr std::size_t max_chunk = 1 << 30;
+
+			block.compressed.clear();
+			block.compressed.reserve(deflateBound(&stream, static_cast<uLong>(std::min(block.filtered.size(), max_chunk))));
+
+			unsigned char *in = block.filtered.data();
+			std::size_t remaining = block.filtered.size();
+			do
+			{
+				stream.next_in = in;
+				stream.avail_in = static_cast<uInt>(std::min(remaining, max_chunk));
+				in += stream.avail_in;
+				remaining -= stream.avail_in;
+
+				// a sync flush ends the block on a byte boundary without ending the stream
+				int flush = remaining ? Z_NO_FLUSH : last ? Z_FINISH : Z_SYNC_FLUSH;
+				do
+				{
+					static constexpr std::size_t out_chunk = 1 << 20;
+					std::size_t size = block.compressed.size();
+					block.compressed.resize(size + out_chunk);
+					stream.next_out = block.compressed.data() + size;
+					stream.avail_out = static_cast<uInt>(out_chunk);
+
+					if (deflate(&stream, flush) == Z_STREAM_ERROR)
+						throw std::runtime_error("Compression failed");
+
+					block.compressed.resize(size + out_chunk - stream.avail_out);
+				} while (!stream.avail_out);
+			} while (remaining);
+
+			block.adler = adler32_z(adler32(0, nullptr, 0), block.filtered.data(), block.filtered.size());
+		});
+
+		// stitch the blocks together into one zlib stream
+		for (uint64_t b = 0; b < count; ++b)
+		{
+			png_block &block = blocks[b];
+			std::vector<unsigned char> &data = block.compressed;
+
+			if (first_block + b == 0)
+			{
+				// zlib header, 32k window
+				unsigned char cmf = 0x78;
+				unsigned char level_bits = compression_level < 2 ? 0 : compression_level < 6 ? 1 : compression_level == 6 ? 2 : 3;
+				unsigned char flg = static_cast<unsigned char>(level_bits << 6);
+				flg += static_cast<unsigned char>(31 - (cmf * 256 + flg) % 31);
+				data.insert(data.begin(), {cmf, flg});
+			}
+
+			adler = adler32_combine(adler, block.adler, static_cast<z_off_t>(block.filtered.size()));
+
+			if (first_block + b + 1 == block_count)
+			{
+				unsigned char trailer[4];
+				put_u32(trailer, static_cast<uint32_t>(adler));
+				data.insert(data.end(), trailer, trailer + 4);
+			}
+
+			// chunks can't be larger than 2^31 - 1 bytes
+			for (std::size_t pos = 0; pos < data.size(); pos += 1 << 30)
+				write_chunk(out, "IDAT", data.data() + pos, static_cast<uint32_t>(std::min<std::size_t>(data.size() - pos, 1 << 30)));
+		}
+
+		auto &tail = blocks[count - 1].filtered;
+		std::size_t dict_len = std::min<std::size_t>(tail.size(), 32768);
+		dictionary.assign(tail.end() - dict_len, tail.end());
+
+		prog.add(std::min(height - first_block * block_rows, count * block_rows));
+	}
+
+	write_chunk(out, "IEND", nullptr, 0);
+
+	out.flush();
+}
+
+void image::check_limits(uint64_t width, uint64_t height, int depth, color_t col)
+{
+	if (height > PNG_UINT_31_MAX)
+		throw std::length_error("Image height exceeds limit");
+	if (width > PNG_UINT_32_MAX / ((depth * static_cast<uint64_t>(col) + 7) / 8))
+		throw std::length_error("Image width exceeds limit");
+	assert_color_depth(col, depth);
+}
+
+// writes gen's rows to sink, in parallel with a pool of more than one thread
+uint64_t write_rows_to(const image::png_sink &sink, uint64_t width, uint64_t height, int depth, color_t col, const image::row_generator &gen, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback, thread_pool *pool)
+{
+	sink_writer out(sink);
+	if (pool && pool->size() > 1)
+		write_png_parallel(out, width, height, depth, col, gen, text_chunks, compression_level, std::move(callback), *pool);
+	else
+		write_png(out, width, height, depth, col, gen, text_chunks, compression_level, std::move(callback));
+	return out.written();
+}
+
+image::png_sink image::fd_sink(int fd)
+{
+	return [fd](const unsigned char *data, std::size_t len) {
+		while (len)
+		{
+#ifdef MKMZ_POSIX_IO
+			ssize_t n = ::write(fd, data, len);
+			if (n < 0 && errno == EINTR)
+				continue;
+#elif defined(_WIN32)
+			int n = _write(fd, data, static_cast<unsigned int>(std::min<std::size_t>(len, 1 << 30)));
+#else
+			int n = -1;
+#endif
+			if (n <= 0)
+				throw std::runtime_error("Could not write to file");
+			data += n;
+			len -= n;
+		}
+	};
+}
+
+image::png_sink image::file_sink(FILE *file)
+{
+	return [file](const unsigned char *data, std::size_t len) {
+		if (fwrite(data, 1, len, file) != len)
+			throw std::runtime_error("Could not write to file");
+	};
+}
+
+image::png_sink image::file_sink(const std::string &name)
+{
+	std::shared_ptr<FILE> file(fopen(name.data(), "wb"), [](FILE *f) { if (f) fclose(f); });
+	if (!file)
+		throw std::runtime_error("Could not open file for writing");
+	// writes already come in big blocks
+	setvbuf(file.get(), nullptr, _IONBF, 0);
+
+	return [file](const unsigned char *data, std::size_t len) {
+		if (fwrite(data, 1, len, file.get()) != len)
+			throw std::runtime_error("Could not write to file");
+	};
+}
+
+image::png_sink image::memory_sink(std::string &out)
+{
+	return [&out](const unsigned char *data, std::size_t len) {
+		out.append(reinterpret_cast<const char *>(data), len);
+	};
+}
+
+uint64_t image::write(const std::string &name, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback, thread_pool *pool) const
+{
+	return write(file_sink(name), text_chunks, compression_level, std::move(callback), pool);
+}
+
+uint64_t image::write(const png_sink &sink, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback, thread_pool *pool) const
+{
+	return write_rows_to(sink, m_width, m_height, m_depth, m_col, [this](uint64_t y, base_t *) { return row(y); }, text_chunks, compression_level, std::move(callback), pool);
+}
+
+std::string image::encode(const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, thread_pool *pool) const
+{
+	std::string res;
+	write(memory_sink(res), text_chunks, compression_level, {}, pool);
+	return res;
+}
+
+uint64_t image::write_rows(const std::string &name, uint64_t width, uint64_t height, int depth, color_t col, const row_generator &gen, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback, thread_pool *pool)
+{
+	// checked before the file is made
+	check_limits(width, height, depth, col);
+	return write_rows(file_sink(name), width, height, depth, col, gen, text_chunks, compression_level, std::move(callback), pool);
+}
+
+uint64_t image::write_rows(const png_sink &sink, uint64_t width, uint64_t height, int depth, color_t col, const row_generator &gen, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level, std::function<void(double)> callback, thread_pool *pool)
+{
+	check_limits(width, height, depth, col);
+	return write_rows_to(sink, width, height, depth, col, gen, text_chunks, compression_level, std::move(callback), pool);
+}
+
+uint64_t image::rows_in_flight(uint64_t width, int depth, color_t col, const thread_pool *pool)
+{
+	// libpng asks for rows in order
+	if (!pool || pool->size() <= 1)
+		return 1;
+	// a whole batch of blocks is filtered at once, and every block reads the row above it too
+	return png_batch_size(*pool) * png_block_rows(width, depth, col) + 1;
+}
 
 void image::draw_horizontal_line(uint64_t x, uint64_t y, uint64_t len, const uint16_t *color)
 {
 	if (x + len > m_width || y >= m_height)
 		throw std::runtime_error("Pixel out of range");
 
-	const std::lock_guard lock(row_locks[y]);
+	fill_row(row(y), x, len, m_depth, m_col, color);
+}
+
+namespace
+{
+	// bytes of color pattern a fill kernel stores per iteration at most, a multiple of every pixel size and of the widest register
+	constexpr std::size_t pattern_bytes = 192;
+	// spans shorter than this are filled a byte at a time, building the pattern would cost more than it saves
+	constexpr std::size_t min_pattern_fill = 64;
+
+	// fills bytes bytes of data with pattern, which repeats every pixel bytes and holds pattern_bytes + 64 bytes
+	// the kernels store the first register unaligned and start the pattern pixel bytes in where they need to, so every store after it is aligned
+	using fill_kernel = void (*)(unsigned char *data, std::size_t bytes, const unsigned char *pattern, std::size_t pixel);
+
+#ifndef MKMZ_SSE2
+	void fill_scalar(unsigned char *data, std::size_t bytes, const unsigned char *pattern, std::size_t)
+	{
+		for (; bytes >= pattern_bytes; bytes -= pattern_bytes, data += pattern_bytes)
+			std::memcpy(data, pattern, pattern_bytes);
+		std::memcpy(data, pattern, bytes);
+	}
+#else
+	// moves data to the next multiple of align, after its first align bytes have been stored unaligned
+	inline void align_fill(unsigned char *&data, std::size_t &bytes, const unsigned char *&pattern, std::size_t pixel, std::size_t align)
+	{
+		std::size_t head = (align - reinterpret_cast<std::uintptr_t>(data) % align) % align;
+		data += head;
+		bytes -= head;
+		pattern += head % pixel;
+	}
+
+	// 48 bytes, 16 pixels of 3 bytes, is the shortest run of pattern that fills whole registers
+	void fill_sse2(unsigned char *data, std::size_t bytes, const unsigned char *pattern, std::size_t pixel)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(data), _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern)));
+		align_fill(data, bytes, pattern, pixel, 16);
+
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern + 32));
+		for (; bytes >= 48; bytes -= 48, data += 48)
+		{
+			_mm_store_si128(reinterpret_cast<__m128i *>(data), a);
+			_mm_store_si128(reinterpret_cast<__m128i *>(data + 16), b);
+			_mm_store_si128(reinterpret_cast<__m128i *>(data + 32), c);
+		}
+		std::memcpy(data, pattern, bytes);
+	}
+#endif
+
+#ifdef MKMZ_X86_DISPATCH
+	__attribute__((target("avx2"))) void fill_avx2(unsigned char *data, std::size_t bytes, const unsigned char *pattern, std::size_t pixel)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(data), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pattern)));
+		align_fill(data, bytes, pattern, pixel, 32);
 
-	uint64_t channel_count = static_cast<uint64_t>(m_col);
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pattern));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pattern + 32));
+		__m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pattern + 64));
+		for (; bytes >= 96; bytes -= 96, data += 96)
+		{
+			_mm256_store_si256(reinterpret_cast<__m256i *>(data), a);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(data + 32), b);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(data + 64), c);
+		}
+		std::memcpy(data, pattern, bytes);
+	}
+
+	__attribute__((target("avx512f"))) void fill_avx512(unsigned char *data, std::size_t bytes, const unsigned char *pattern, std::size_t pixel)
+	{
+		_mm512_storeu_si512(data, _mm512_loadu_si512(pattern));
+		align_fill(data, bytes, pattern, pixel, 64);
 
-	auto &row = m_data[y];
+		__m512i a = _mm512_loadu_si512(pattern);
+		__m512i b = _mm512_loadu_si512(pattern + 64);
+		__m512i c = _mm512_loadu_si512(pattern + 128);
+		for (; bytes >= 192; bytes -= 192, data += 192)
+		{
+			_mm512_store_si512(data, a);
+			_mm512_store_si512(data + 64, b);
+			_mm512_store_si512(data + 128, c);
+		}
+		std::memcpy(data, pattern, bytes);
+	}
+#endif
 
-	if (m_depth == 1)
+	fill_kernel pick_fill_kernel()
+	{
+#ifdef MKMZ_X86_DISPATCH
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return fill_avx512;
+		if (__builtin_cpu_supports("avx2"))
+			return fill_avx2;
+#endif
+#ifdef MKMZ_SSE2
+		return fill_sse2;
+#else
+		return fill_scalar;
+#endif
+	}
+
+	const fill_kernel fill_pattern = pick_fill_kernel();
+}
+
+void image::reverse_bits(unsigned char *data, uint64_t len)
+{
+	for (uint64_t i = 0; i < len; ++i)
+		data[i] = bit_reverse.table[data[i]];
+}
+
+void image::fill_row(base_t *row, uint64_t x, uint64_t len, int depth, color_t col, const uint16_t *color)
+{
+	if (!len)
+		return;
+
+	uint64_t channel_count = static_cast<uint64_t>(col);
+
+	if (depth == 1)
 	{
 		uint64_t bit_i = x;
 
@@ -206,9 +808,28 @@ void image::draw_horizontal_line(uint64_t x, uint64_t y, uint64_t len, const uin
 	else
 	{
 		uint64_t i = x * channel_count;
-		unsigned char *data = reinterpret_cast<unsigned char *>(row.data()) + i;
-		for (; len; --len)
-			for (uint64_t c = 0; c < channel_count; ++c, ++data)
-				*data = color[c];
+		unsigned char *data = reinterpret_cast<unsigned char *>(row) + i;
+		uint64_t bytes = len * channel_count;
+
+		if (channel_count == 1)
+			std::memset(data, color[0], bytes);
+		else if (bytes < min_pattern_fill)
+		{
+			for (; len; --len)
+				for (uint64_t c = 0; c < channel_count; ++c, ++data)
+					*data = color[c];
+		}
+		else
+		{
+			// one pixel, doubled until it fills the pattern
+			constexpr std::size_t size = pattern_bytes + 64;
+			alignas(64) unsigned char pattern[size];
+			for (uint64_t c = 0; c < channel_count; ++c)
+				pattern[c] = static_cast<unsigned char>(color[c]);
+			for (std::size_t n = channel_count; n < size; n *= 2)
+				std::memcpy(pattern + n, pattern, std::min(n, size - n));
+
+			fill_pattern(data, bytes, pattern, channel_count);
+		}
 	}
 }
\ No newline at end of file
@@ -1,12 +1,15 @@
 #pragma once
+#include <cstdio>
 #include <string>
 #include <stdexcept>
 #include <functional>
 #include <limits>
 #include <vector>
-#include <mutex>
+#include <new>
 #include <utility>
 
+#include "thread_pool.h"
+
 enum class channel_t : uint64_t
 {
     gray = 0,
@@ -29,37 +32,113 @@ enum class color_t : uint64_t
     rgba = 4,
 };
 
+// allocates memory aligned to a cache line
+template <typename T, std::size_t alignment = 64>
+struct aligned_allocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = aligned_allocator<U, alignment>;
+    };
+
+    aligned_allocator() = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, alignment> &) {}
+
+    inline T *allocate(std::size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{alignment})); }
+    inline void deallocate(T *p, std::size_t) { ::operator delete(p, std::align_val_t{alignment}); }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U, alignment> &) const { return true; }
+};
+
 // only supports depths 1 and 8
-// intended for multithreaded drawing to image
+// rows are stored back to back in one buffer, each starting on a cache line
+// drawing directly to an image isn't thread safe, threads should draw to their own strips instead
 class image
 {
 public:
-    static bool within_limits(uint64_t width, uint64_t height);
+    using base_t = uint64_t;
 
-    inline image() : m_width{}, m_height{}, m_depth{}, m_col{} {}
-    image(uint64_t width, uint64_t height, int depth, color_t col);
+    // called with a row index and a buffer of at least row_len() elements, must return a pointer to the row (usually buf)
+    // the row only has to stay valid until gen is called again on the same thread
+    using row_generator = std::function<const base_t *(uint64_t y, base_t *buf)>;
 
-    inline image(const image &other) : m_width{other.m_width}, m_height{other.m_height}, m_depth{other.m_depth}, m_col{other.m_col}, m_data{other.m_data}, row_locks(m_height)
+    // rows [first, last) of an image
+    // a strip is meant to be owned by a single thread, so different threads can draw to different strips without locking
+    // everything drawn to a strip is clipped to its rows
+    class strip
     {
-    }
+    public:
+        inline uint64_t first() const { return m_first; }
+        inline uint64_t last() const { return m_last; }
 
-    inline image &operator=(const image &other)
-    {
-        m_width = other.m_width;
-        m_height = other.m_height;
-        m_depth = other.m_depth;
-        m_col = other.m_col;
-        m_data = other.m_data;
-        row_locks = std::vector<std::mutex>(m_height);
+        // y is a row of the image, not of the strip, and has to be one of the strip's rows
+        inline base_t *row(uint64_t y)
+        {
+            if (y < m_first || y >= m_last)
+                throw std::runtime_error("Row outside of strip");
+            return m_img->row(y);
+        }
 
-        return *this;
-    }
+        inline void set_pixel(uint64_t x, uint64_t y, const uint16_t *color)
+        {
+            if (y >= m_first && y < m_last)
+                m_img->set_pixel(x, y, color);
+        }
+
+        inline void draw_vertical_line(uint64_t x, uint64_t y, uint64_t len, const uint16_t *color)
+        {
+            if (clip(y, len))
+                m_img->draw_vertical_line(x, y, len, color);
+        }
+
+        inline void draw_horizontal_line(uint64_t x, uint64_t y, uint64_t len, const uint16_t *color)
+        {
+            if (y >= m_first && y < m_last)
+                m_img->draw_horizontal_line(x, y, len, color);
+        }
+
+    private:
+        friend class image;
+
+        inline strip(image &img, uint64_t first, uint64_t last) : m_img{&img}, m_first{first}, m_last{last} {}
 
-    inline image(image &&other) : m_width{other.m_width}, m_height{other.m_height}, m_depth{other.m_depth}, m_col{other.m_col}, m_data{std::move(other.m_data)}, row_locks{std::move(other.row_locks)}
+        image *m_img;
+        uint64_t m_first, m_last;
+
+        // clips the rows [y, y + len) to the strip, returns false if nothing is left
+        inline bool clip(uint64_t &y, uint64_t &len) const
+        {
+            uint64_t end = y + len;
+            if (y < m_first)
+                y = m_first;
+            if (end > m_last)
+                end = m_last;
+            if (y >= end)
+                return false;
+            len = end - y;
+            return true;
+        }
+    };
+
+    static bool within_limits(uint64_t width, uint64_t height);
+
+    inline image() : m_width{}, m_height{}, m_depth{}, m_col{}, m_stride{} {}
+    image(uint64_t width, uint64_t height, int depth, color_t col);
+
+    image(const image &other) = default;
+    image &operator=(const image &other) = default;
+
+    inline image(image &&other) : m_width{other.m_width}, m_height{other.m_height}, m_depth{other.m_depth}, m_col{other.m_col}, m_stride{other.m_stride}, m_data{std::move(other.m_data)}
     {
         other.m_width = other.m_height = 0;
         other.m_depth = 0;
         other.m_col = color_t::none;
+        other.m_stride = 0;
     }
 
     inline image &operator=(image &&other)
@@ -68,12 +147,13 @@ public:
         m_height = other.m_height;
         m_depth = other.m_depth;
         m_col = other.m_col;
+        m_stride = other.m_stride;
         m_data = std::move(other.m_data);
-        row_locks = std::move(other.row_locks);
 
         other.m_width = other.m_height = 0;
         other.m_depth = 0;
         other.m_col = color_t::none;
+        other.m_stride = 0;
 
         return *this;
     }
@@ -85,6 +165,14 @@ public:
         m_col = color_t::none;
     }
 
+    // hands out rows [first, last) to be drawn to by one thread
+    inline strip get_strip(uint64_t first, uint64_t last)
+    {
+        if (first > last || last > m_height)
+            throw std::runtime_error("Strip out of range");
+        return strip(*this, first, last);
+    }
+
     /// @brief sets pixel at x, y to color
     /// @param x x coordinate
     /// @param y y coordinate
@@ -93,9 +181,9 @@ public:
     {
         if (x >= m_width || y >= m_height)
             throw std::runtime_error("Pixel out of range");
-        
-        const std::lock_guard lock(row_locks[y]);
-        
+
+        base_t *data = row(y);
+
         uint64_t channel_count = static_cast<uint64_t>(m_col);
         uint64_t bit_i = m_depth * x * channel_count;
         for (uint64_t channel = 0; channel < channel_count; ++channel, bit_i += m_depth)
@@ -104,8 +192,8 @@ public:
             uint64_t bit_off = bit_i % 64;
 
             base_t mask = (static_cast<base_t>(-1) >> (64 - m_depth));
-            m_data[y][base_i] &= ~(mask << bit_off);   // could be put on the outside, but I don't care
-            m_data[y][base_i] |= (color[channel] & mask) << bit_off;
+            data[base_i] &= ~(mask << bit_off);   // could be put on the outside, but I don't care
+            data[base_i] |= (color[channel] & mask) << bit_off;
         }
     }
 
@@ -127,8 +215,61 @@ public:
     /// @param color pointer to uint16_t array that is large enough to hold all channels in the image
     void draw_horizontal_line(uint64_t x, uint64_t y, uint64_t len, const uint16_t *color);
 
+    /// @brief draws horizontal line from x of length len with color color into a single row that isn't owned by an image
+    /// @param row pointer to the row, must be at least row_len(width, depth, col) long
+    /// @param x x coordinate to start from
+    /// @param len length of line
+    /// @param depth depth of the row
+    /// @param col color type of the row
+    /// @param color pointer to uint16_t array that is large enough to hold all channels in the row
+    static void fill_row(base_t *row, uint64_t x, uint64_t len, int depth, color_t col, const uint16_t *color);
+
+    // rows of depth 1 are packed starting at the lowest bit of each byte, png packs them starting at the highest
+    // reverses the bits of every byte of data, turning one order into the other
+    static void reverse_bits(unsigned char *data, uint64_t len);
+
+    // receives a png as it's written, in blocks of up to a megabyte or so, and throws std::runtime_error if it can't take them
+    using png_sink = std::function<void(const unsigned char *data, std::size_t len)>;
+
+    // sink that writes to a file descriptor, such as 1 for stdout
+    static png_sink fd_sink(int fd);
+    // sink that writes to a stdio stream opened for binary writing, which is left open
+    static png_sink file_sink(FILE *file);
+    // sink that writes to a new file called name, which is closed once the last copy of the sink is gone
+    static png_sink file_sink(const std::string &name);
+    // sink that appends to out, which must outlive the sink
+    static png_sink memory_sink(std::string &out);
+
     // compression level ranges from 0-9. 9 is max, 0 is no compression, callback is a function that takes a double between 0 and 1 representing the progess
-    void write(const std::string &name, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level = 4, std::function<void(double)> callback = {}) const;
+    // with a pool of more than one thread, blocks of rows are filtered and compressed in parallel
+    // returns the size of the png in bytes
+    uint64_t write(const std::string &name, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level = 4, std::function<void(double)> callback = {}, thread_pool *pool = nullptr) const;
+    // same as above, to sink
+    uint64_t write(const png_sink &sink, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level = 4, std::function<void(double)> callback = {}, thread_pool *pool = nullptr) const;
+    // same as above, but the png is returned
+    std::string encode(const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level = 4, thread_pool *pool = nullptr) const;
+
+    // writes an image that is never stored in memory, gen is called once for every row
+    // with a pool of more than one thread, gen is called concurrently and rows aren't requested in order
+    // returns the size of the png in bytes
+    static uint64_t write_rows(const std::string &name, uint64_t width, uint64_t height, int depth, color_t col, const row_generator &gen, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level = 4, std::function<void(double)> callback = {}, thread_pool *pool = nullptr);
+    // same as above, to sink
+    static uint64_t write_rows(const png_sink &sink, uint64_t width, uint64_t height, int depth, color_t col, const row_generator &gen, const std::vector<std::pair<std::string, std::string>> &text_chunks, int compression_level = 4, std::function<void(double)> callback = {}, thread_pool *pool = nullptr);
+
+    // most rows write_rows can be between the oldest and the newest row it has asked gen for at any time
+    static uint64_t rows_in_flight(uint64_t width, int depth, color_t col, const thread_pool *pool = nullptr);
+
+    // number of base_t's in one row
+    inline static uint64_t row_len(uint64_t width, int depth, color_t col)
+    {
+        uint64_t len_bits = width * depth * static_cast<uint64_t>(col);
+        // round up
+        return (len_bits + 63) / 64;
+    }
+
+    // direct access to a row, the caller has to make sure no other thread is drawing to it
+    inline base_t *row(uint64_t y) { return m_data.data() + y * m_stride; }
+    inline const base_t *row(uint64_t y) const { return m_data.data() + y * m_stride; }
 
     inline uint64_t width() const { return m_width; }
     inline uint64_t height() const { return m_height; }
@@ -142,19 +283,19 @@ private:
     int m_depth;
     color_t m_col;
 
-    using base_t = uint64_t;
+    // distance between rows in base_t's, a multiple of a cache line
+    uint64_t m_stride;
 
-    // represent as vector of vectors for better multithreading
-    std::vector<std::vector<base_t>> m_data;
-    std::vector<std::mutex> row_locks;
+    std::vector<base_t, aligned_allocator<base_t>> m_data;
 
     inline uint64_t row_len() const
     {
-        uint64_t len_bits = m_width * m_depth * static_cast<uint64_t>(m_col);
-        // round up
-        return (len_bits + 63) / 64;
+        return row_len(m_width, m_depth, m_col);
     }
 
+    // throws if a png of width x height can't be written with depth and col
+    static void check_limits(uint64_t width, uint64_t height, int depth, color_t col);
+
     inline static void assert_color_depth(color_t col, int depth)
     {
         switch (col)
@@ -0,0 +1,364 @@
+#include "json.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+class json_value::parser
+{
+public:
+	inline explicit parser(std::string_view text) : m_text{text}, m_pos{} {}
+
+	json_value parse()
+	{
+		json_value res = value(0);
+		skip_space();
+		if (m_pos != m_text.size())
+			fail("unexpected text after the value");
+		return res;
+	}
+
+private:
+	// deeper documents are refused instead of overflowing the stack
+	static constexpr int max_depth = 64;
+
+	std::string_view m_text;
+	std::size_t m_pos;
+
+	[[noreturn]] void fail(const char *what) const
+	{
+		throw std::runtime_error("Invalid json at " + std::to_string(m_pos) + ": " + what);
+	}
+
+	void skip_space()
+	{
+		while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+			++m_pos;
+	}
+
+	bool take(char c)
+	{
+		skip_space();
+		if (m_pos < m_text.size() && m_text[m_pos] == c)
+		{
+			++m_pos;
+			return true;
+		}
+		return false;
+	}
+
+	void expect(char c)
+	{
+		if (!take(c))
+			fail("expected a different character");
+	}
+
+	bool take_word(std::string_view word)
+	{
+		if (m_text.substr(m_pos, word.size()) != word)
+			return false;
+		m_pos += word.size();
+		return true;
+	}
+
+	json_value value(int depth)
+	{
+		if (depth > max_depth)
+			fail("nested too deeply");
+
+		skip_space();
+		if (m_pos == m_text.size())
+			fail("expected a value");
+
+		json_value res;
+		char c = m_text[m_pos];
+		if (c == '{')
+		{
+			++m_pos;
+			res.m_type = type::object;
+			if (take('}'))
+				return res;
+			do
+			{
+				skip_space();
+				std::string key = string();
+				expect(':');
+				res.m_object.emplace_back(std::move(key), value(depth + 1));
+			} while (take(','));
+			expect('}');
+		}
+		else if (c == '[')
+		{
+			++m_pos;
+			res.m_type = type::array;
+			if (take(']'))
+				return res;
+			do
+				res.m_array.push_back(value(depth + 1));
+			while (take(','));
+			expect(']');
+		}
+		else if (c == '"')
+		{
+			res.m_type = type::string;
+			res.m_string = string();
+		}
+		else if (take_word("true"))
+		{
+			res.m_type = type::boolean;
+			res.m_bool = true;
+		}
+		else if (take_word("false"))
+			res.m_type = type::boolean;
+		else if (take_word("null"))
+			res.m_type = type::null;
+		else
+		{
+			res.m_type = type::number;
+			res.m_number = number();
+		}
+		return res;
+	}
+
+	double number()
+	{
+		std::size_t start = m_pos;
+		auto digits = [this] {
+			std::size_t first = m_pos;
+			while (m_pos < m_text.size() && m_text[m_pos] >= '0' && m_text[m_pos] <= '9')
+				++m_pos;
+			return m_pos != first;
+		};
+
+		take_word("-");
+		if (!digits())
+			fail("expected a value");
+		if (take_word(".") && !digits())
+			fail("expected digits after the decimal point");
+		if (take_word("e") || take_word("E"))
+		{
+			if (!take_word("+"))
+				take_word("-");
+			if (!digits())
+				fail("expected digits in the exponent");
+		}
+
+		return std::strtod(std::string(m_text.substr(start, m_pos - start)).c_str(), nullptr);
+	}
+
+	unsigned int hex4()
+	{
+		if (m_pos + 4 > m_text.size())
+			fail("unfinished escape");
+		unsigned int res = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			char c = m_text[m_pos++];
+			res <<= 4;
+			if (c >= '0' && c <= '9')
+				res |= c - '0';
+			else if (c >= 'a' && c <= 'f')
+				res |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F')
+				res |= c - 'A' + 10;
+			else
+				fail("bad escape");
+		}
+		return res;
+	}
+
+	std::string string()
+	{
+		if (m_pos == m_text.size() || m_text[m_pos] != '"')
+			fail("expected a string");
+		++m_pos;
+
+		std::string res;
+		for (;;)
+		{
+			if (m_pos == m_text.size())
+				fail("unfinished string");
+			char c = m_text[m_pos++];
+			if (c == '"')
+				return res;
+			if (static_cast<unsigned char>(c) < 0x20)
+				fail("control character in a string");
+			if (c != '\\')
+			{
+				res += c;
+				continue;
+			}
+
+			if (m_pos == m_text.size())
+				fail("unfinished escape");
+			switch (m_text[m_pos++])
+			{
+			case '"': res += '"'; break;
+			case '\\': res += '\\'; break;
+			case '/': res += '/'; break;
+			case 'b': res += '\b'; break;
+			case 'f': res += '\f'; break;
+			case 'n': res += '\n'; break;
+			case 'r': res += '\r'; break;
+			case 't': res += '\t'; break;
+			case 'u':
+			{
+				unsigned int code = hex4();
+				// surrogate pairs make up one code point
+				if (code >= 0xd800 && code < 0xdc00 && take_word("\\u"))
+				{
+					unsigned int low = hex4();
+					if (low < 0xdc00 || low >= 0xe000)
+						fail("bad surrogate pair");
+					code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+				}
+
+				// utf-8
+				if (code < 0x80)
+					res += static_cast<char>(code);
+				else if (code < 0x800)
+				{
+					res += static_cast<char>(0xc0 | (code >> 6));
+					res += static_cast<char>(0x80 | (code & 0x3f));
+				}
+				else if (code < 0x10000)
+				{
+					res += static_cast<char>(0xe0 | (code >> 12));
+					res += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+					res += static_cast<char>(0x80 | (code & 0x3f));
+				}
+				else
+				{
+					res += static_cast<char>(0xf0 | (code >> 18));
+					res += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+					res += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+					res += static_cast<char>(0x80 | (code & 0x3f));
+				}
+				break;
+			}
+			default:
+				fail("bad escape");
+			}
+		}
+	}
+};
+
+json_value json_value::parse(std::string_view text)
+{
+	return parser(text).parse();
+}
+
+bool json_value::as_bool() const
+{
+	if (m_type != type::boolean)
+		throw std::runtime_error("Expected true or false");
+	return m_bool;
+}
+
+double json_value::as_number() const
+{
+	if (m_type != type::number)
+		throw std::runtime_error("Expected a number");
+	return m_number;
+}
+
+std::uint64_t json_value::as_uint() const
+{
+	double n = as_number();
+	// 2^64, the first double that doesn't fit
+	if (n < 0 || n >= 18446744073709551616.0 || std::floor(n) != n)
+		throw std::runtime_error("Expected a whole number that isn't negative");
+	return static_cast<std::uint64_t>(n);
+}
+
+const std::string &json_value::as_string() const
+{
+	if (m_type != type::string)
+		throw std::runtime_error("Expected a string");
+	return m_string;
+}
+
+const std::vector<json_value> &json_value::as_array() const
+{
+	if (m_type != type::array)
+		throw std::runtime_error("Expected an array");
+	return m_array;
+}
+
+const json_value *json_value::find(const std::string &key) const
+{
+	if (m_type != type::object)
+		throw std::runtime_error("Expected an object");
+	// the last one wins if a key is repeated
+	for (auto it = m_object.rbegin(); it != m_object.rend(); ++it)
+		if (it->first == key)
+			return &it->second;
+	return nullptr;
+}
+
+std::string json_value::dump() const
+{
+	switch (m_type)
+	{
+	case type::null:
+		return "null";
+	case type::boolean:
+		return m_bool ? "true" : "false";
+	case type::number:
+	{
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.17g", m_number);
+		return buf;
+	}
+	case type::string:
+		return json_quote(m_string);
+	case type::array:
+	{
+		std::string res = "[";
+		for (std::size_t i = 0; i < m_array.size(); ++i)
+		{
+			if (i)
+				res += ", ";
+			res += m_array[i].dump();
+		}
+		return res + ']';
+	}
+	case type::object:
+	{
+		std::string res = "{";
+		for (std::size_t i = 0; i < m_object.size(); ++i)
+		{
+			if (i)
+				res += ", ";
+			res += json_quote(m_object[i].first);
+			res += ": ";
+			res += m_object[i].second.dump();
+		}
+		return res + '}';
+	}
+	}
+	return "null";
+}
+
+std::string json_quote(const std::string &str)
+{
+	std::string res = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+		{
+			res += '\\';
+			res += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			char buf[8];
+			std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned int>(c));
+			res += buf;
+		}
+		else
+			res += c;
+	}
+	return res + '"';
+}
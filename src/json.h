@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// just enough json for requests and reports, values are parsed into a tree and written with json_quote
+class json_value
+{
+public:
+    enum class type
+    {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object,
+    };
+
+    inline json_value() : m_type{type::null}, m_bool{}, m_number{}, m_string{}, m_array{}, m_object{} {}
+
+    // throws std::runtime_error if text isn't a single json value
+    static json_value parse(std::string_view text);
+
+    inline type get_type() const { return m_type; }
+    inline bool is_null() const { return m_type == type::null; }
+
+    // these throw std::runtime_error if the value is of a different type
+    bool as_bool() const;
+    double as_number() const;
+    // throws if the number isn't a whole number that fits
+    std::uint64_t as_uint() const;
+    const std::string &as_string() const;
+    const std::vector<json_value> &as_array() const;
+
+    // member of an object, nullptr if there's no such member, throws if this isn't an object
+    const json_value *find(const std::string &key) const;
+
+    // the value written back out as json
+    std::string dump() const;
+
+private:
+    type m_type;
+    bool m_bool;
+    double m_number;
+    std::string m_string;
+    std::vector<json_value> m_array;
+    // members in the order they were written
+    std::vector<std::pair<std::string, json_value>> m_object;
+
+    class parser;
+};
+
+// str as a json string, with quotes
+std::string json_quote(const std::string &str);
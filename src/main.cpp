@@ -3,20 +3,26 @@
 #include <fstream>
 #include <filesystem>
 #include <sstream>
+#include <memory>
+#include <cstring>
+
+#ifdef _WIN32
+	#include <fcntl.h>
+	#include <io.h>
+#endif
 
 #include "maze.h"
 #include "image.h"
+#include "render.h"
+#include "thread_pool.h"
+#include "mapped.h"
+#include "ellers.h"
+#include "stats.h"
+#include "progress.h"
+#include "algorithm.h"
+#include "server.h"
 
-#include <format>
-
-enum class algorithm_type
-{
-	recursive_backtracker,
-	wilsons,
-	recursive_division,
-};
-
-void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_width, uint64_t &maze_height, uint64_t &cell_width, uint64_t &cell_height, uint64_t &wall_width, uint16_t *wall_color, uint16_t *cell_color, uint_least32_t &seed, algorithm_type &algorithm);
+void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_width, uint64_t &maze_height, uint64_t &cell_width, uint64_t &cell_height, uint64_t &wall_width, uint16_t *wall_color, uint16_t *cell_color, uint_least32_t &seed, algorithm_type &algorithm, bool &stream, unsigned int &thread_count, int &compression_level, maze::layout &layout, std::string &mmap_dir, std::string &stats_name, std::vector<uint_least32_t> &batch_seeds, bool &serve, std::string &socket_path, std::string &save_name, std::string &load_name);
 
 void progress_bar(double progress)
 {
@@ -33,14 +39,14 @@ void progress_bar(double progress)
 	std::cout.flush();
 }
 
-std::string get_coords(uint64_t x, uint64_t y) { return std::format("({}, {})", x, y); }
+void draw_image(const maze &mz, image &img, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *wall_color, uint16_t *cell_color, thread_pool &pool);
 
-void draw_image(const maze &mz, image &img, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *wall_color, uint16_t *cell_color);
+// name with " (0)", " (1)", ... before the extension if the file already exists, so nothing is overwritten
+std::string version_name(const std::string &name);
+
+// makes a maze for every seed, one maze per task on the pool, and writes each to name_template with {seed} and {index} filled in
+int run_batch(const std::vector<uint_least32_t> &seeds, const std::string &name_template, uint64_t maze_width, uint64_t maze_height, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *wall_color, uint16_t *cell_color, int depth, color_t color_type, algorithm_type algorithm, int compression_level, maze::layout layout, thread_pool &pool, run_stats &stats, const std::string &stats_name);
 
-bool is_gray(uint16_t *color)
-{
-	return color[0] == color[1] && color[0] == color[2];
-}
 
 int main(int argc, char *argv[])
 {   
@@ -59,68 +65,170 @@ int main(int argc, char *argv[])
 
 	algorithm_type algorithm;
 
-	process_args(argc, argv, image_name, maze_width, maze_height, cell_width, cell_height, wall_width, wall_color, cell_color, seed, algorithm);
+	// render rows while writing instead of drawing the whole image first
+	bool stream;
 
-	uint64_t image_width = (cell_width + wall_width) * maze_width + wall_width;
-	uint64_t image_height = (cell_height + wall_width) * maze_height + wall_width;
+	unsigned int thread_count;
+	int compression_level;
 
-	if (!image::within_limits(image_width, image_height))
+	maze::layout layout;
+
+	// directory for memory mapped maze storage, empty if the maze is kept in ram
+	std::string mmap_dir;
+
+	// file the run statistics are written to as json, empty if they aren't wanted
+	std::string stats_name;
+
+	// seeds of the mazes to make in one go, empty for a single maze
+	std::vector<uint_least32_t> batch_seeds;
+
+	// answer requests on stdin, or on the unix socket at socket_path if it isn't empty, instead of making one maze
+	bool serve;
+	std::string socket_path;
+
+	// .mz file the maze is saved to once it's made, and .mz file a saved maze is drawn from instead of making one, empty if unused
+	std::string save_name;
+	std::string load_name;
+
+	// with -o - the png goes to stdout, so every message goes to stderr instead, even ones about the options
+	bool to_stdout = false;
+	for (int i = 1; i + 1 < argc; ++i)
+		if (strcmp(argv[i], "-o") == 0 && strcmp(argv[i + 1], "-") == 0)
+			to_stdout = true;
+	if (to_stdout)
 	{
-		std::cout << "Image width and or height are too large. Aborting...\n";
-		return 1;
+		std::cout.rdbuf(std::cerr.rdbuf());
+#ifdef _WIN32
+		// no newline translation in the png
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
 	}
 
-	color_t color_type;
-	int depth;
-	if (is_gray(wall_color) && is_gray(cell_color))
+	process_args(argc, argv, image_name, maze_width, maze_height, cell_width, cell_height, wall_width, wall_color, cell_color, seed, algorithm, stream, thread_count, compression_level, layout, mmap_dir, stats_name, batch_seeds, serve, socket_path, save_name, load_name);
+
+	mapped::set_directory(mmap_dir);
+
+	// threads are started once and shared by every stage
+	thread_pool pool(thread_count);
+
+	if (serve)
 	{
-		if (wall_color[3] == 255 && cell_color[3] == 255)
+		maze_server server(pool);
+		try
 		{
-			if ((wall_color[0] == 0 || wall_color[0] == 255) &&
-				(cell_color[0] == 0 || cell_color[0] == 255))
-				depth = 1;
+			if (socket_path.empty())
+				// stdout carries the responses, so nothing else is written to it
+				server.serve(std::cin, std::cout);
 			else
-				depth = 8;
-			color_type = color_t::gray;
+			{
+				std::cout << "Serving on " << socket_path << " with " << pool.size() << " thread" << (pool.size() != 1 ? "s" : "") << "...\n";
+				std::cout.flush();
+				server.serve_socket(socket_path);
+			}
 		}
-		else
+		catch (const std::runtime_error &e)
+		{
+			std::cerr << e.what() << ". Aborting...\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	run_stats stats;
+
+	maze m;
+	// a loaded maze is drawn as it was saved, without generating or analysing it again
+	bool loaded = !load_name.empty();
+	if (loaded)
+	{
+		std::cout << "Loading maze...\n";
+		auto begin = std::chrono::high_resolution_clock::now();
+		stats.begin("load");
+
+		uint32_t tag;
+		try
+		{
+			tag = m.load(load_name);
+		}
+		catch (const std::runtime_error &e)
+		{
+			std::cout << e.what() << ". Aborting...\n";
+			return 1;
+		}
+		if (tag > static_cast<uint32_t>(algorithm_type::ellers))
 		{
-			depth = 8;
-			color_type = color_t::gray_alpha;
+			std::cout << load_name << " was made by an unknown algorithm. Aborting...\n";
+			return 1;
 		}
+
+		algorithm = static_cast<algorithm_type>(tag);
+		maze_width = m.width();
+		maze_height = m.height();
+
+		stats.end();
+
+		std::cout << "Maze loading finished in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() << "s\n";
 	}
 	else
+		m.set_dims(maze_width, maze_height);
+
+	uint64_t image_width = (cell_width + wall_width) * maze_width + wall_width;
+	uint64_t image_height = (cell_height + wall_width) * maze_height + wall_width;
+
+	if (!image::within_limits(image_width, image_height))
 	{
-		depth = 8;
-		if (wall_color[3] == 255 && cell_color[3] == 255)
-			color_type = color_t::rgb;
-		else
-			color_type = color_t::rgba;
+		std::cout << "Image width and or height are too large. Aborting...\n";
+		return 1;
 	}
 
+	color_t color_type;
+	int depth;
+	pick_format(wall_color, cell_color, depth, color_type);
+
+	if (!batch_seeds.empty())
+		return run_batch(batch_seeds, image_name, maze_width, maze_height, cell_width, cell_height, wall_width, wall_color, cell_color, depth, color_type, algorithm, compression_level, layout, pool, stats, stats_name);
+
 	image res;
 	pt entrance, exit;
 	double difficulty;
 	maze::len_t solution_branch_count, solution_distance;
 
+	// streamed eller's mazes are made while the image is written and never stored, so they can't be analysed
+	bool analysed = loaded || !(stream && algorithm == algorithm_type::ellers);
+
+	if (loaded)
+		std::cout << "Maze loaded from " << load_name << ", skipping generation...\n";
+	else if (!analysed)
+	{
+		if (seed != static_cast<uint_least32_t>(-1))
+			m.set_seed(seed);
+		seed = m.get_seed();
+
+		entrance = {0, 0};
+		exit = {maze_width - 1, maze_height - 1};
+		difficulty = 0;
+		solution_branch_count = solution_distance = 0;
+
+		std::cout << "Maze will be generated while the image is written...\n";
+	}
+	else
 	{
 		std::cout << "Generating maze...\n";
 		auto begin = std::chrono::high_resolution_clock::now();
-		maze m(maze_width, maze_height);
+		// includes analysing the maze
+		stats.begin("generate");
 
 		if (seed != static_cast<uint_least32_t>(-1))
 			m.set_seed(seed);
 
+		m.set_layout(layout);
+
 		m.set_progress_callback(progress_bar);
+		m.set_thread_pool(&pool);
 
 		try
 		{
-			if (algorithm == algorithm_type::recursive_backtracker)
-				m.gen_recursive_backtracker();
-			else if (algorithm == algorithm_type::wilsons)
-				m.gen_wilsons();
-			else if (algorithm == algorithm_type::recursive_division)
-				m.gen_recursive_division();
+			generate(m, algorithm);
 		}
 		catch (const std::bad_alloc &e)
 		{
@@ -133,6 +241,14 @@ int main(int argc, char *argv[])
 			return 1;
 		}
 
+		stats.end();
+		stats.rate("cells_per_second", static_cast<double>(maze_width) * maze_height);
+
+		std::cout << "\nMaze generation finished in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() << "s\n";
+	}
+
+	if (analysed)
+	{
 		entrance = m.entrance();
 		exit = m.exit();
 		difficulty = m.difficulty();
@@ -140,14 +256,35 @@ int main(int argc, char *argv[])
 		solution_distance = m.solution_distance();
 
 		seed = m.get_seed();
+	}
 
-		std::cout << "\nMaze generation finished in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() << "s\n";
+	if (!save_name.empty())
+	{
+		std::cout << "Saving maze...\n";
+		auto begin = std::chrono::high_resolution_clock::now();
+		stats.begin("save");
+
+		try
+		{
+			m.save(save_name, static_cast<uint32_t>(algorithm));
+		}
+		catch (const std::runtime_error &e)
+		{
+			std::cout << e.what() << ". Aborting...\n";
+			return 1;
+		}
+
+		stats.end();
+
+		std::cout << "Maze save finished in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() << "s\n";
+	}
 
+	// when streaming, rows are drawn as they are written
+	if (!stream)
+	{
 		std::cout << "Drawing image...\n";
 		std::cout.flush();
 
-		begin = std::chrono::high_resolution_clock::now();
-
 		try
 		{
 			res = image(image_width, image_height, depth, color_type);
@@ -168,60 +305,55 @@ int main(int argc, char *argv[])
 			return 1;
 		}
 
-		draw_image(m, res, cell_width, cell_height, wall_width, wall_color, cell_color);
+		auto begin = std::chrono::high_resolution_clock::now();
+		stats.begin("draw");
+
+		draw_image(m, res, cell_width, cell_height, wall_width, wall_color, cell_color, pool);
+
+		stats.end();
+		stats.rate("cells_per_second", static_cast<double>(maze_width) * maze_height);
+		stats.rate("pixels_per_second", static_cast<double>(image_width) * image_height);
 
 		std::cout << "\nImage drawing finished in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() << "s\n";
-	}
 
-	const char *algorithm_name;
-	switch (algorithm)
-	{
-	case algorithm_type::recursive_backtracker:
-		algorithm_name = "Recursive Backtracker";
-		break;
-	case algorithm_type::wilsons:
-		algorithm_name = "Wilson's Algorithm";
-		break;
-	case algorithm_type::recursive_division:
-		algorithm_name = "Recursive Division";
-		break;
+		// maze is no longer needed
+		m = maze();
 	}
 
-	const char *difficulty_str;
-	// choices for range are not arbitrary, and have been statistically calculated
-	if (difficulty < 2)
-		difficulty_str = "Ridiculously Easy";
-	else if (difficulty < 2.5)
-		difficulty_str = "Easy";
-	else if (difficulty < 3)
-		difficulty_str = "Medium Difficulty";
-	else if (difficulty < 3.5)
-		difficulty_str = "Hard";
-	else if (difficulty < 5.0)
-		difficulty_str = "Ridiculously Hard";
-	else if (difficulty < 15.0)
-		difficulty_str = "Humanly Impossible";
-	else
-		difficulty_str = "Computer will struggle";
+	const char *algorithm_name = get_algorithm_name(algorithm);
+	const char *difficulty_str = get_difficulty_name(difficulty);
 
 	std::cout << "Writing image...\n";
 	auto begin = std::chrono::high_resolution_clock::now();
+	uint64_t size;
+	// with --stream this includes drawing, and making the maze if it isn't stored
+	stats.begin("write");
 	try
 	{
-		std::vector<std::pair<std::string, std::string>> chunks = {
-			std::pair<std::string, std::string>{"Author", "Generated by program mkmz created by JC Squires"},
-			std::pair<std::string, std::string>{"Maze Seed", std::to_string(seed)},
-			std::pair<std::string, std::string>{"Maze Dimensions", get_coords(maze_width, maze_height)},
-			std::pair<std::string, std::string>{"Cell Dimensions", get_coords(cell_width, cell_height)},
-			std::pair<std::string, std::string>{"Wall Width", std::to_string(wall_width)},
-			std::pair<std::string, std::string>{"Maze Entrance", get_coords(entrance.x, entrance.y)},
-			std::pair<std::string, std::string>{"Maze Exit", get_coords(exit.x, exit.y)},
-			std::pair<std::string, std::string>{"Maze Generation Algorithm", algorithm_name},
-			std::pair<std::string, std::string>{"Maze difficulty", std::to_string(difficulty) + " (" + difficulty_str + ')'},
-			std::pair<std::string, std::string>{"Solution Branch Count", std::to_string(solution_branch_count)},
-			std::pair<std::string, std::string>{"Solution Distance", std::to_string(solution_distance)},
-		};
-		res.write(image_name, chunks, 5, progress_bar);
+		auto chunks = get_text_chunks(seed, maze_width, maze_height, cell_width, cell_height, wall_width, entrance, exit, algorithm, analysed, difficulty, solution_branch_count, solution_distance);
+		image::png_sink sink = to_stdout ? image::fd_sink(1) : image::file_sink(image_name);
+
+		if (stream)
+		{
+			maze_renderer::row_source source = [&m](maze::len_t y, uint64_t *up, uint64_t *right) { m.get_row(y, up, right); };
+
+			// the maze is made as the rows are drawn, and only the rows the writer may still come back to are kept
+			std::unique_ptr<ellers_window> rows;
+			if (!analysed)
+			{
+				maze::len_t capacity = image::rows_in_flight(image_width, depth, color_type, &pool) / (cell_height + wall_width) + 3;
+				rows = std::make_unique<ellers_window>(maze_width, maze_height, seed, capacity);
+				source = [&rows](maze::len_t y, uint64_t *up, uint64_t *right) { rows->get_row(y, up, right); };
+			}
+
+			maze_renderer renderer(std::move(source), maze_width, maze_height, entrance, exit, cell_width, cell_height, wall_width, wall_color, cell_color, depth, color_type);
+			// rows that are the same as the one before are handed to the writer again instead of being rendered again
+			size = image::write_rows(sink, image_width, image_height, depth, color_type, [&renderer](uint64_t y, image::base_t *) {
+				return renderer.render_row_cached(y);
+			}, chunks, compression_level, progress_bar, &pool);
+		}
+		else
+			size = res.write(sink, chunks, compression_level, progress_bar, &pool);
 	}
 	catch (const std::runtime_error &e)
 	{
@@ -231,7 +363,10 @@ int main(int argc, char *argv[])
 
 	std::cout << "\nImage write finished in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() << "s\n";
 
-	std::uintmax_t size = std::filesystem::file_size(image_name);
+	stats.end();
+	stats.rate("cells_per_second", static_cast<double>(maze_width) * maze_height);
+	stats.rate("pixels_per_second", static_cast<double>(image_width) * image_height);
+	stats.rate("compressed_bytes_per_second", static_cast<double>(size));
 	double d = static_cast<double>(size);
 	int i = 0;
 	for (; d >= 1024; d /= 1024, ++i);
@@ -241,12 +376,15 @@ int main(int argc, char *argv[])
 	std::cout << "\tMaze dimensions: (" << maze_width << ", " << maze_height << ")\n";
 	std::cout << "\tMaze entrance: (" << entrance.x << ", " << entrance.y << ")\n";
 	std::cout << "\tMaze exit: (" << exit.x << ", " << exit.y << ")\n";
-	std::cout << "\tMaze difficulty: " << difficulty << " (" << difficulty_str << ")\n";
-	std::cout << "\tSolution branch count: " << solution_branch_count << '\n';
-	std::cout << "\tSolution distance: " << solution_distance << '\n';
+	if (analysed)
+	{
+		std::cout << "\tMaze difficulty: " << difficulty << " (" << difficulty_str << ")\n";
+		std::cout << "\tSolution branch count: " << solution_branch_count << '\n';
+		std::cout << "\tSolution distance: " << solution_distance << '\n';
+	}
 	std::cout << "\tMaze generation algorithm: " << algorithm_name << '\n';
 	std::cout << "\tMaze seed: " << seed << '\n';
-	std::cout << "\tImage name: " << image_name << '\n';
+	std::cout << "\tImage name: " << (to_stdout ? "(stdout)" : image_name) << '\n';
 	std::cout << "\tImage size: " << d << "BKMGTPE"[i];
 	if (i)
 		std::cout << "B (" << size << ')';
@@ -271,219 +409,216 @@ int main(int argc, char *argv[])
 	}
 
 	std::cout << "\tColor type: " << color_type_str << '\n';
-	std::cout << "\tImage dimensions: (" << res.width() << ", " << res.height() << ")\n";
+	std::cout << "\tImage dimensions: (" << image_width << ", " << image_height << ")\n";
 	std::cout << "\tCell dimensions: (" << cell_width << ", " << cell_height << ")\n";
 	std::cout << "\tWall width: " << wall_width << '\n';
-}
 
-void draw_vert_line(image &img, uint64_t x, uint64_t y, uint64_t len, uint64_t width, const uint16_t *color)
-{
-	for (; width; --width, ++x)
-		img.draw_vertical_line(x, y, len, color);
-}
+	if (!stats_name.empty())
+	{
+		stats.property("maze_width", maze_width);
+		stats.property("maze_height", maze_height);
+		stats.property("algorithm", algorithm_name);
+		stats.property("seed", static_cast<uint64_t>(seed));
+		stats.property("entrance", entrance);
+		stats.property("exit", exit);
+		if (analysed)
+		{
+			stats.property("difficulty", difficulty);
+			stats.property("solution_branch_count", static_cast<uint64_t>(solution_branch_count));
+			stats.property("solution_distance", static_cast<uint64_t>(solution_distance));
+		}
+		if (loaded)
+			stats.property("loaded_from", load_name);
+		if (!save_name.empty())
+			stats.property("saved_to", save_name);
+		stats.property("image_name", image_name);
+		stats.property("image_width", image_width);
+		stats.property("image_height", image_height);
+		stats.property("image_bytes", static_cast<uint64_t>(size));
+		stats.property("depth", static_cast<uint64_t>(depth));
+		stats.property("color_type", color_type_str);
+		stats.property("cell_width", cell_width);
+		stats.property("cell_height", cell_height);
+		stats.property("wall_width", wall_width);
+		stats.property("compression_level", static_cast<uint64_t>(compression_level));
+		stats.property("streamed", stream);
+		stats.property("threads", static_cast<uint64_t>(pool.size()));
+		stats.property("hardware_threads", static_cast<uint64_t>(std::thread::hardware_concurrency()));
 
-void draw_horiz_line(image &img, uint64_t x, uint64_t y, uint64_t len, uint64_t width, const uint16_t *color)
-{
-	for (; width; --width, ++y)
-		img.draw_horizontal_line(x, y, len, color);
+		try
+		{
+			stats.write(stats_name);
+		}
+		catch (const std::runtime_error &e)
+		{
+			std::cout << e.what() << '\n';
+			return 1;
+		}
+	}
 }
 
 #include <thread>
 
-void progress_task(const std::vector<std::size_t> &progress, std::size_t total)
+void draw_image(const maze &mz, image &img, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *wall_color, uint16_t *cell_color, thread_pool &pool)
 {
-	using namespace std::chrono_literals;
+	std::cout << "Using " << pool.size() << " thread";
+	if (pool.size() != 1)
+		std::cout << 's';
+	std::cout << ".\n";
 
-	std::size_t last = -1;
+	maze_renderer renderer(mz, cell_width, cell_height, wall_width, wall_color, cell_color, img.depth(), img.color());
 
-	for (;;)
-	{
-		std::size_t i = 0;
-		for (auto p : progress)
-			i += p;
+	progress_reporter prog(progress_bar, img.height(), &pool);
 
-		if (i != last)
-		{
-			progress_bar(static_cast<double>(i) / total);
-			last = i;
-		}
+	render_image(renderer, img, pool, &prog);
+}
 
-		if (i == total)
-			return;
+std::string version_name(const std::string &name)
+{
+	std::ifstream file(name);
+	if (!file.is_open())
+		return name;
 
-		std::this_thread::sleep_for(100ms);
-	}
+	int iteration = 0;
+	std::string pot;
+	do
+	{
+		auto dot = name.find_last_of('.');
+		pot = name.substr(0, dot);
+		pot += " (";
+		pot += std::to_string(iteration);
+		pot += ')';
+		if (dot != std::string::npos)
+			pot += name.substr(dot);
+
+		file.close();
+		file.open(pot);
+
+		++iteration;
+	} while (file.is_open());
+	return pot;
 }
 
-void draw_task(std::size_t &progress, const maze &mz, image &img, maze::len_t y, maze::len_t num_rows, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *wall_color)
+int run_batch(const std::vector<uint_least32_t> &seeds, const std::string &name_template, uint64_t maze_width, uint64_t maze_height, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *wall_color, uint16_t *cell_color, int depth, color_t color_type, algorithm_type algorithm, int compression_level, maze::layout layout, thread_pool &pool, run_stats &stats, const std::string &stats_name)
 {
-	uint64_t total_width = cell_width + 2 * wall_width;
-	uint64_t total_height = cell_height + 2 * wall_width;
+	std::cout << "Making " << seeds.size() << " mazes with " << pool.size() << " thread";
+	if (pool.size() != 1)
+		std::cout << 's';
+	std::cout << "...\n";
 
-	maze::len_t end = y + num_rows;
-	if (end > mz.height())
-		end = mz.height();
-	for (; y < end; ++y)
+	uint64_t image_width = (cell_width + wall_width) * maze_width + wall_width;
+	uint64_t image_height = (cell_height + wall_width) * maze_height + wall_width;
+
+	// every thread keeps its maze and image between mazes, so their buffers are only allocated once
+	struct buffers
 	{
-		auto image_y = (cell_height + wall_width) * y;
+		maze m;
+		image img;
+	};
+	std::vector<std::unique_ptr<buffers>> thread_buffers(pool.size());
 
-		for (maze::len_t x = 0; x < mz.width(); ++x)
-		{
-			auto image_x = (cell_width + wall_width) * x;
+	// versioning names has to see the files written so far
+	std::mutex names_lock;
 
-			// draw bottom wall
-			if (!mz.is_wall_open({x, y}, maze::direction::down))
-				draw_horiz_line(img, image_x, image_y, total_width, wall_width, wall_color);
+	auto begin = std::chrono::high_resolution_clock::now();
+	stats.begin("batch");
 
-			// draw left wall
-			if (!mz.is_wall_open({x, y}, maze::direction::left))
-				draw_vert_line(img, image_x, image_y, total_height, wall_width, wall_color);
+	try
+	{
+		progress_reporter prog(progress_bar, seeds.size(), &pool);
 
-			++progress;
-		}
-	}
-}
+		// the mazes are small, so each one is made on one thread and the threads work on different mazes
+		pool.parallel_for(0, seeds.size(), 1, [&](uint64_t first, uint64_t last) {
+			auto &b = thread_buffers[pool.thread_index()];
+			if (!b)
+				b = std::make_unique<buffers>(buffers{maze(maze_width, maze_height), image(image_width, image_height, depth, color_type)});
 
-void draw_exit(const maze &mz, image &img, pt p, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *cell_color)
-{
-	// if on left wall
-	if (p.x == 0)
-	{
-		draw_vert_line(img,
-					   0,                                                            // image_x
-					   (cell_height + wall_width) * p.y + wall_width, // image_y
-					   cell_height, wall_width, cell_color);
-	}
-	// if on right wall
-	else if (p.x == mz.width() - 1)
-	{
-		draw_vert_line(img,
-					   (cell_width + wall_width) * p.x + cell_width + wall_width, // image_x
-					   (cell_height + wall_width) * p.y + wall_width,             // image_y
-					   cell_height, wall_width, cell_color);
+			for (uint64_t i = first; i < last; ++i)
+			{
+				maze &m = b->m;
+				m.set_seed(seeds[i]);
+				m.set_layout(layout);
+				generate(m, algorithm);
+
+				maze_renderer renderer(m, cell_width, cell_height, wall_width, wall_color, cell_color, depth, color_type);
+				render_rows(renderer, 0, image_height, [&b](uint64_t y) { return b->img.row(y); });
+
+				std::string name = name_template;
+				for (auto [key, value] : {std::pair<std::string, std::string>{"{seed}", std::to_string(seeds[i])}, {"{index}", std::to_string(i)}})
+					for (auto at = name.find(key); at != std::string::npos; at = name.find(key, at + value.size()))
+						name.replace(at, key.size(), value);
+
+				{
+					const std::lock_guard lock(names_lock);
+					name = version_name(name);
+					// claims the name before it's written, so no other thread picks it
+					std::ofstream{name};
+				}
+
+				auto chunks = get_text_chunks(seeds[i], maze_width, maze_height, cell_width, cell_height, wall_width, m.entrance(), m.exit(), algorithm, true, m.difficulty(), m.solution_branch_count(), m.solution_distance());
+				try
+				{
+					b->img.write(name, chunks, compression_level);
+				}
+				catch (...)
+				{
+					// the name was claimed with an empty file, which mustn't be left behind
+					std::error_code ec;
+					std::filesystem::remove(name, ec);
+					throw;
+				}
+
+				prog.add(1);
+			}
+		});
 	}
-	// if on top wall
-	else if (p.y == 0)
+	catch (const std::bad_alloc &e)
 	{
-		draw_horiz_line(img,
-						(cell_width + wall_width) * p.x + wall_width, // image_x
-						0,                                                           // image_y
-						cell_width, wall_width, cell_color);
+		std::cout << "\rCouldn't allocate enough memory... aborting\n";
+		return 1;
 	}
-	// if on bottom wall
-	else if (p.y == mz.height() - 1)
+	catch (const std::runtime_error &e)
 	{
-		draw_horiz_line(img,
-						(cell_width + wall_width) * p.x + wall_width,                // image_x
-						(cell_height + wall_width) * p.y + cell_height + wall_width, // image_y
-						cell_width, wall_width, cell_color);
+		std::cout << '\r' << e.what() << ". Aborting...\n";
+		return 1;
 	}
-}
-
-void draw_image(const maze &mz, image &img, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, uint16_t *wall_color, uint16_t *cell_color)
-{
-	constexpr maze::len_t max_threads = 500;
-	constexpr maze::len_t max_threads_target_height = 100000;
-	constexpr maze::len_t max_threads_factor = max_threads_target_height / max_threads;
-	maze::len_t num_threads = (img.height() + max_threads_factor - 1) / max_threads_factor;
-	if (num_threads > max_threads)
-		num_threads = max_threads;
-
-
-	std::cout << "Using " << num_threads << " thread";
-	if (num_threads != 1)
-		std::cout << 's';
-	std::cout << ".\n";
-
-	std::vector<std::thread> threads;
 
-	threads.reserve(num_threads);
-	
-	// progress stores an array of integers that each represent a thread
-	std::vector<std::size_t> progress(num_threads + 2, 0);
-	std::size_t progress_total = num_threads * 2 + 2 + mz.height() * mz.width() + 3;
-	std::size_t &progress_singles = progress[num_threads];
+	stats.end();
+	stats.rate("mazes_per_second", static_cast<double>(seeds.size()));
+	stats.rate("cells_per_second", static_cast<double>(maze_width) * maze_height * seeds.size());
+	stats.rate("pixels_per_second", static_cast<double>(image_width) * image_height * seeds.size());
 
-	std::thread progress_thread(progress_task, std::ref(progress), progress_total);
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+	std::cout << "\nMade " << seeds.size() << " mazes in " << seconds << "s (" << seeds.size() / seconds << " mazes/s)\n";
 
+	if (!stats_name.empty())
 	{
-		auto division_height = img.height() / num_threads;
-
-		// clear maze to cell color
-		maze::len_t y = 0;
-		for (maze::len_t t = 0; t < num_threads; ++t)
-		{
-			threads.emplace_back(draw_horiz_line, std::ref(img), 0, y, img.width() - wall_width, division_height, cell_color);
-			y += division_height;
-		}
-
-		// draw remainder of rows
-		draw_horiz_line(img, 0, y, img.width() - wall_width, img.height() - y, cell_color);
-		++progress_singles;
+		stats.property("maze_width", maze_width);
+		stats.property("maze_height", maze_height);
+		stats.property("algorithm", get_algorithm_name(algorithm));
+		stats.property("count", static_cast<uint64_t>(seeds.size()));
+		stats.property("first_seed", static_cast<uint64_t>(seeds.front()));
+		stats.property("image_width", image_width);
+		stats.property("image_height", image_height);
+		stats.property("threads", static_cast<uint64_t>(pool.size()));
+		stats.property("hardware_threads", static_cast<uint64_t>(std::thread::hardware_concurrency()));
 
-		for (std::size_t t = 0; t < num_threads; ++t)
-		{
-			threads[t].join();
-			++progress_singles;
-		}
-
-		threads.clear();
-
-		// draw right wall
-		y = 0;
-		for (maze::len_t t = 0; t < num_threads; ++t)
-		{
-			threads.emplace_back(draw_horiz_line, std::ref(img), img.width() - wall_width, y, wall_width, division_height, wall_color);
-			y += division_height;
-		}
-
-		// draw remainder of right wall
-		draw_horiz_line(img, img.width() - wall_width, y, wall_width, img.height() - y, wall_color);
-		++progress_singles;
-
-		for (std::size_t t = 0; t < num_threads; ++t)
+		try
 		{
-			threads[t].join();
-			++progress_singles;
+			stats.write(stats_name);
 		}
-
-		threads.clear();
-	}
-
-	{
-		auto mz_division_height = mz.height() / num_threads;
-
-		// draw maze
-		maze::len_t y = 0;
-		for (maze::len_t t = 0; t < num_threads; ++t)
+		catch (const std::runtime_error &e)
 		{
-			threads.emplace_back(draw_task, std::ref(progress[t]), std::ref(mz), std::ref(img), y, mz_division_height, cell_width, cell_height, wall_width, wall_color);
-			y += mz_division_height;
+			std::cout << e.what() << '\n';
+			return 1;
 		}
-
-		// draw remainder of maze
-		draw_task(progress[num_threads + 1], mz, img, y, mz.height() - y, cell_width, cell_height, wall_width, wall_color);
-
-		for (std::size_t t = 0; t < num_threads; ++t)
-			threads[t].join();
 	}
 
-	// draw bottom line
-	draw_horiz_line(img, 0, img.height() - wall_width, img.width(), wall_width, wall_color);
-	++progress_singles;
-
-	// draw entrance
-	draw_exit(mz, img, mz.entrance(), cell_width, cell_height, wall_width, cell_color);
-	++progress_singles;
-
-	// draw exit
-	draw_exit(mz, img, mz.exit(), cell_width, cell_height, wall_width, cell_color);
-	++progress_singles;
-
-	progress_thread.join();
+	return 0;
 }
 
 #include <regex>
+#include <algorithm>
 #include <cstring>
 
 bool try_conversion(const std::string &str, unsigned long long &res)
@@ -529,7 +664,7 @@ bool is_valid_filename(const char *name)
 	#endif
 }
 
-void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_width, uint64_t &maze_height, uint64_t &cell_width, uint64_t &cell_height, uint64_t &wall_width, uint16_t *wall_color, uint16_t *cell_color, uint_least32_t &seed, algorithm_type &algorithm)
+void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_width, uint64_t &maze_height, uint64_t &cell_width, uint64_t &cell_height, uint64_t &wall_width, uint16_t *wall_color, uint16_t *cell_color, uint_least32_t &seed, algorithm_type &algorithm, bool &stream, unsigned int &thread_count, int &compression_level, maze::layout &layout, std::string &mmap_dir, std::string &stats_name, std::vector<uint_least32_t> &batch_seeds, bool &serve, std::string &socket_path, std::string &save_name, std::string &load_name)
 {
 	if (argc == 1)
 	{
@@ -540,11 +675,28 @@ void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_widt
 					 "    -ww [WALL WIDTH]                          Set the width of the walls in pixels (defaults to 1)\n"
 					 "    -wcol \"[R], [G], [B], [A]\"              Set the color of the walls in rgba values ranged 0-255 (Defaults to \"0, 0, 0, 255\")\n"
 					 "    -ccol \"[R], [G], [B], [A]\"              Set the color of the cells in rgba values ranged 0-255 (Defaults to \"255, 255, 255, 255\")\n"
-					 "    -o [MAZE NAME].png                        Sets the name of the resulting image (Defaults to [WIDTH]x[HEIGHT]_maze.png)\n"
+					 "    -o [MAZE NAME].png                        Sets the name of the resulting image (Defaults to [WIDTH]x[HEIGHT]_maze.png), - writes it to stdout and every message to stderr\n"
 					 "    -s [SEED]                                 Sets the seed of the maze to be generated (Defaults to a random seed)\n"
 					 "    --rb                                      Use recursive backtracking algorithm (default)\n"
+					 "    --prb                                     Use recursive backtracking in parallel, on 1024x1024 cell tiles that are joined together\n"
 					 "    --w                                       Use Wilson's algorithm\n"
-					 "    --rd                                      Use recursive division algorithm\n";
+					 "    --pw                                      Use Wilson's algorithm with many walkers in parallel\n"
+					 "    --rd                                      Use recursive division algorithm\n"
+					 "    --k                                       Use Kruskal's algorithm, generated in parallel\n"
+					 "    --e                                       Use Eller's algorithm, with --stream the maze is never stored so its height is unlimited\n"
+					 "    --stream                                  Draw the image row by row while writing it instead of storing the whole image\n"
+					 "    -threads [THREADS]                        Sets the number of threads used to analyse the maze and to draw and compress the image (Defaults to the number of cores)\n"
+					 "    -clevel [LEVEL]                           Sets the compression level of the image from 0-9 (Defaults to 5)\n"
+					 "    --tiled                                   Store the maze in square tiles, only faster once a row of the maze no longer fits in cache (about a million cells wide)\n"
+					 "    -mmap [DIRECTORY]                         Keep the maze in memory mapped files in DIRECTORY, for mazes bigger than memory\n"
+					 "    -stats-json [FILE]                        Write the time, memory and throughput of every phase and the maze's properties to FILE as json\n"
+					 "    -count [COUNT]                            Make COUNT mazes with seeds counting up from -s, in parallel in one process\n"
+					 "    -seeds [FILE]                             Make a maze for every seed in FILE, in parallel in one process\n"
+					 "                                              With -count or -seeds, {seed} and {index} in the -o name are replaced for every maze\n"
+					 "    --serve                                   Answer maze requests, one json object per line, on stdin with one line of json per response on stdout\n"
+					 "    -socket [PATH]                            Same as --serve, but on a unix socket at PATH that any number of clients can connect to\n"
+					 "    -save [FILE]                              Also save the maze to FILE in .mz format, so it can be drawn again with -from\n"
+					 "    -from [FILE]                              Draw the maze saved in the .mz FILE instead of generating one, -dims, -s and the algorithm come from FILE\n";
 		std::exit(0);
 	}
 
@@ -560,10 +712,29 @@ void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_widt
 	bool found_ccol = false;
 	bool found_o = false;
 	bool found_s = false;
+	bool found_threads = false;
+	bool found_clevel = false;
+	bool found_mmap = false;
+	bool found_stats = false;
+	bool found_count = false;
+	bool found_seeds = false;
+	bool found_socket = false;
+	bool found_save = false;
+	bool found_from = false;
+
+	unsigned long long count = 0;
 
 	bool found_rb = false;
+	bool found_prb = false;
 	bool found_w = false;
+	bool found_pw = false;
 	bool found_rd = false;
+	bool found_k = false;
+	bool found_e = false;
+
+	stream = false;
+	layout = maze::layout::row_major;
+	serve = false;
 
 	for (int i = 1; i < argc; ++i)
 	{
@@ -781,16 +952,25 @@ void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_widt
 		}
 		else if (strcmp(argv[i], "--rb") == 0)
 		{
-			if (found_w || found_rd)
+			if (found_w || found_rd || found_k || found_e || found_prb || found_pw)
 			{
 				std::cout << "Ignoring repeated algorithm type...\n";
 				continue;
 			}
 			found_rb = true;
 		}
+		else if (strcmp(argv[i], "--prb") == 0)
+		{
+			if (found_rb || found_w || found_rd || found_k || found_e || found_pw)
+			{
+				std::cout << "Ignoring repeated algorithm type...\n";
+				continue;
+			}
+			found_prb = true;
+		}
 		else if (strcmp(argv[i], "--rd") == 0)
 		{
-			if (found_w || found_rb)
+			if (found_w || found_rb || found_k || found_e || found_prb || found_pw)
 			{
 				std::cout << "Ignoring repeated algorithm type...\n";
 				continue;
@@ -799,13 +979,278 @@ void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_widt
 		}
 		else if (strcmp(argv[i], "--w") == 0)
 		{
-			if (found_rb || found_rd)
+			if (found_rb || found_rd || found_k || found_e || found_prb || found_pw)
 			{
 				std::cout << "Ignoring repeated algorithm type...\n";
 				continue;
 			}
 			found_w = true;
 		}
+		else if (strcmp(argv[i], "--pw") == 0)
+		{
+			if (found_rb || found_prb || found_w || found_rd || found_k || found_e)
+			{
+				std::cout << "Ignoring repeated algorithm type...\n";
+				continue;
+			}
+			found_pw = true;
+		}
+		else if (strcmp(argv[i], "--k") == 0)
+		{
+			if (found_rb || found_w || found_rd || found_e || found_prb || found_pw)
+			{
+				std::cout << "Ignoring repeated algorithm type...\n";
+				continue;
+			}
+			found_k = true;
+		}
+		else if (strcmp(argv[i], "--e") == 0)
+		{
+			if (found_rb || found_w || found_rd || found_k || found_prb || found_pw)
+			{
+				std::cout << "Ignoring repeated algorithm type...\n";
+				continue;
+			}
+			found_e = true;
+		}
+		else if (strcmp(argv[i], "--stream") == 0)
+			stream = true;
+		else if (strcmp(argv[i], "--tiled") == 0)
+			layout = maze::layout::tiled;
+		else if (strcmp(argv[i], "--serve") == 0)
+			serve = true;
+		else if (strcmp(argv[i], "-threads") == 0)
+		{
+			if (found_threads)
+			{
+				std::cout << "Ignoring repeat argument -threads\n";
+				continue;
+			}
+
+			unsigned long long res;
+			if (i + 1 == argc || !try_conversion(argv[i + 1], res) || res == 0)
+			{
+				std::cout << "Value for -threads missing or incorrectly formatted, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			thread_count = static_cast<unsigned int>(res);
+
+			found_threads = true;
+		}
+		else if (strcmp(argv[i], "-clevel") == 0)
+		{
+			if (found_clevel)
+			{
+				std::cout << "Ignoring repeat argument -clevel\n";
+				continue;
+			}
+
+			unsigned long long res;
+			if (i + 1 == argc || !try_conversion(argv[i + 1], res) || res > 9)
+			{
+				std::cout << "Value for -clevel missing or incorrectly formatted, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			compression_level = static_cast<int>(res);
+
+			found_clevel = true;
+		}
+		else if (strcmp(argv[i], "-mmap") == 0)
+		{
+			if (found_mmap)
+			{
+				std::cout << "Ignoring repeat argument -mmap\n";
+				continue;
+			}
+
+			if (!mapped::supported())
+			{
+				std::cout << "Memory mapped storage isn't supported on this platform, ignoring -mmap...\n";
+				++i;
+				continue;
+			}
+
+			if (i + 1 == argc || !std::filesystem::is_directory(argv[i + 1]))
+			{
+				std::cout << "Value for -mmap missing or not a directory, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			mmap_dir = argv[i];
+
+			found_mmap = true;
+		}
+		else if (strcmp(argv[i], "-stats-json") == 0)
+		{
+			if (found_stats)
+			{
+				std::cout << "Ignoring repeat argument -stats-json\n";
+				continue;
+			}
+
+			if (i + 1 == argc)
+			{
+				std::cout << "Value for -stats-json missing, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			stats_name = argv[i];
+
+			found_stats = true;
+		}
+		else if (strcmp(argv[i], "-count") == 0)
+		{
+			if (found_count || found_seeds)
+			{
+				std::cout << "Ignoring repeat argument -count\n";
+				continue;
+			}
+
+			if (i + 1 == argc || !try_conversion(argv[i + 1], count) || count == 0)
+			{
+				std::cout << "Value for -count missing or incorrectly formatted, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			found_count = true;
+		}
+		else if (strcmp(argv[i], "-seeds") == 0)
+		{
+			if (found_count || found_seeds)
+			{
+				std::cout << "Ignoring repeat argument -seeds\n";
+				continue;
+			}
+
+			std::ifstream seeds_file;
+			if (i + 1 < argc)
+				seeds_file.open(argv[i + 1]);
+			if (!seeds_file)
+			{
+				std::cout << "Value for -seeds missing or not a readable file, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			unsigned long long res;
+			while (seeds_file >> res)
+				batch_seeds.push_back(static_cast<uint_least32_t>(res));
+
+			if (!seeds_file.eof())
+			{
+				std::cout << "Seeds in " << argv[i] << " incorrectly formatted, aborting...\n";
+				std::exit(0);
+			}
+
+			if (batch_seeds.empty())
+			{
+				std::cout << "No seeds in " << argv[i] << ", aborting...\n";
+				std::exit(0);
+			}
+
+			found_seeds = true;
+		}
+		else if (strcmp(argv[i], "-socket") == 0)
+		{
+			if (found_socket)
+			{
+				std::cout << "Ignoring repeat argument -socket\n";
+				continue;
+			}
+
+			if (!maze_server::socket_supported())
+			{
+				std::cout << "Unix sockets aren't supported on this platform, aborting...\n";
+				std::exit(0);
+			}
+
+			if (i + 1 == argc)
+			{
+				std::cout << "Value for -socket missing, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			socket_path = argv[i];
+			serve = true;
+
+			found_socket = true;
+		}
+		else if (strcmp(argv[i], "-save") == 0)
+		{
+			if (found_save)
+			{
+				std::cout << "Ignoring repeat argument -save\n";
+				continue;
+			}
+
+			if (i + 1 == argc)
+			{
+				std::cout << "Value for -save missing, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			save_name = argv[i];
+
+			found_save = true;
+		}
+		else if (strcmp(argv[i], "-from") == 0)
+		{
+			if (found_from)
+			{
+				std::cout << "Ignoring repeat argument -from\n";
+				continue;
+			}
+
+			if (i + 1 == argc || !std::ifstream(argv[i + 1]))
+			{
+				std::cout << "Value for -from missing or not a readable file, ignoring...\n";
+				continue;
+			}
+
+			++i;
+
+			load_name = argv[i];
+
+			found_from = true;
+		}
+	}
+
+	if (!found_threads)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	// every request brings its own maze options
+	if (serve)
+		return;
+
+	if (found_from)
+	{
+		if (found_count || found_seeds)
+		{
+			std::cout << "-from can't be used with -count or -seeds\n";
+			std::exit(0);
+		}
+		if (found_dims || found_s || found_rb || found_prb || found_w || found_pw || found_rd || found_k || found_e)
+			std::cout << "Ignoring -dims, -s and the algorithm, they come from -from\n";
+		// set once the maze is loaded
+		maze_width = maze_height = 0;
+		found_dims = true;
 	}
 
 	if (!found_dims)
@@ -814,6 +1259,24 @@ void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_widt
 		std::exit(0);
 	}
 
+	if (stream && (found_count || found_seeds))
+	{
+		std::cout << "--stream can't be used with -count or -seeds, batch mazes are drawn whole on every thread\n";
+		std::exit(0);
+	}
+
+	if (found_save && (found_count || found_seeds))
+	{
+		std::cout << "-save can't be used with -count or -seeds\n";
+		std::exit(0);
+	}
+
+	if (found_save && stream && found_e && !found_from)
+	{
+		std::cout << "A maze made by --e with --stream is never stored, so it can't be saved with -save\n";
+		std::exit(0);
+	}
+
 	if (!found_cdims)
 		cell_width = cell_height = 1;
 
@@ -823,12 +1286,38 @@ void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_widt
 	if (!found_ccol)
 		cell_color[0] = cell_color[1] = cell_color[2] = cell_color[3] = 255;
 
-	if (!found_o)
-		name = std::to_string(maze_width) + 'x' + std::to_string(maze_height) + "_maze.png";
+	if (found_o && name == "-" && (found_count || found_seeds))
+	{
+		std::cout << "-o - can't be used with -count or -seeds, every maze needs a file of its own\n";
+		std::exit(0);
+	}
+
+	if (!found_o && found_from)
+		name = std::filesystem::path(load_name).stem().string() + ".png";
+	else if (!found_o)
+		name = std::to_string(maze_width) + 'x' + std::to_string(maze_height) + (found_count || found_seeds ? "_maze_{seed}.png" : "_maze.png");
+	else if ((found_count || found_seeds) && name.find("{seed}") == std::string::npos && name.find("{index}") == std::string::npos)
+	{
+		// every maze needs a name of its own
+		auto dot = name.find_last_of('.');
+		name.insert(dot == std::string::npos ? name.size() : dot, "_{index}");
+	}
+
+	if (found_count)
+	{
+		uint_least32_t first = found_s ? seed : std::random_device{}();
+		for (unsigned long long c = 0; c < count; ++c)
+			batch_seeds.push_back(static_cast<uint_least32_t>(first + c));
+	}
+	else if (found_seeds && found_s)
+		std::cout << "Ignoring -s, the seeds come from -seeds\n";
 
 	if (!found_s)
 		seed = static_cast<uint_least32_t>(-1);
 
+	if (!found_clevel)
+		compression_level = 5;
+
 	if (!found_wcol)
 	{
 		wall_color[0] = wall_color[1] = wall_color[2] = 0;
@@ -837,34 +1326,22 @@ void process_args(int argc, char *argv[], std::string &name, uint64_t &maze_widt
 
 	if (found_rb)
 		algorithm = algorithm_type::recursive_backtracker;
+	else if (found_prb)
+		algorithm = algorithm_type::parallel_backtracker;
 	else if (found_w)
 		algorithm = algorithm_type::wilsons;
+	else if (found_pw)
+		algorithm = algorithm_type::parallel_wilsons;
 	else if (found_rd)
 		algorithm = algorithm_type::recursive_division;
+	else if (found_k)
+		algorithm = algorithm_type::kruskals;
+	else if (found_e)
+		algorithm = algorithm_type::ellers;
 	else
 		algorithm = algorithm_type::recursive_backtracker;
 
-	// version file if necessary
-	std::ifstream file(name);
-	int iteration = 0;
-	if (file.is_open())
-	{
-		std::string pot;
-		do
-		{
-			auto dot = name.find_last_of('.');
-			pot = name.substr(0, dot);
-			pot += " (";
-			pot += std::to_string(iteration);
-			pot += ')';
-			if (dot != std::string::npos)
-				pot += name.substr(dot);
-
-			file.close();
-			file.open(pot);
-
-			++iteration;
-		} while (file.is_open());
-		name = pot;
-	}
+	// batch names are versioned one by one as they're written, and stdout is never versioned
+	if (batch_seeds.empty() && name != "-")
+		name = version_name(name);
 }
\ No newline at end of file
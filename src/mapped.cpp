@@ -0,0 +1,181 @@
+#include "mapped.h"
+
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <unordered_set>
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+	#define MKMZ_MAPPED 1
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace
+{
+	std::string map_dir;
+
+	// buffers that are mapped, everything else came from operator new
+	std::mutex maps_lock;
+	std::unordered_set<const void *> maps;
+}
+
+bool mapped::supported()
+{
+#ifdef MKMZ_MAPPED
+	return true;
+#else
+	return false;
+#endif
+}
+
+void mapped::set_directory(const std::string &dir)
+{
+	map_dir = dir;
+}
+
+const std::string &mapped::directory()
+{
+	return map_dir;
+}
+
+void *mapped::allocate(std::size_t bytes, access hint)
+{
+#ifdef MKMZ_MAPPED
+	if (map_dir.empty() || bytes < min_size)
+		return ::operator new(bytes);
+
+	std::string name = map_dir + "/mkmz-XXXXXX";
+	int fd = mkstemp(name.data());
+	if (fd == -1)
+		throw std::runtime_error("Couldn't create a file in " + map_dir);
+	unlink(name.c_str());
+
+	if (ftruncate(fd, static_cast<off_t>(bytes)) == -1)
+	{
+		close(fd);
+		throw std::runtime_error("Couldn't grow a file in " + map_dir + " to " + std::to_string(bytes) + " bytes");
+	}
+
+	void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	// the mapping keeps the file alive
+	close(fd);
+	if (p == MAP_FAILED)
+		throw std::bad_alloc();
+
+	{
+		const std::lock_guard lock(maps_lock);
+		maps.insert(p);
+	}
+
+	advise(p, bytes, hint);
+	return p;
+#else
+	return ::operator new(bytes);
+#endif
+}
+
+void mapped::deallocate(void *p, std::size_t bytes)
+{
+#ifdef MKMZ_MAPPED
+	// the same test as allocate, so buffers that can't be mapped never take the lock
+	if (map_dir.empty() || bytes < min_size)
+	{
+		::operator delete(p);
+		return;
+	}
+
+	{
+		const std::lock_guard lock(maps_lock);
+		auto it = maps.find(p);
+		if (it != maps.end())
+		{
+			maps.erase(it);
+			munmap(p, bytes);
+			return;
+		}
+	}
+#endif
+	::operator delete(p);
+}
+
+void mapped::advise(const void *p, std::size_t bytes, access hint)
+{
+#ifdef MKMZ_MAPPED
+	if (map_dir.empty() || bytes < min_size)
+		return;
+
+	{
+		const std::lock_guard lock(maps_lock);
+		if (!maps.contains(p))
+			return;
+	}
+
+	int advice = MADV_NORMAL;
+	switch (hint)
+	{
+	case access::sequential:
+		advice = MADV_SEQUENTIAL;
+		break;
+	case access::random:
+		advice = MADV_RANDOM;
+		break;
+	case access::normal:
+		break;
+	}
+	// only a hint, so failing doesn't matter
+	madvise(const_cast<void *>(p), bytes, advice);
+#endif
+}
+
+mapped::file::file(const std::string &name) : m_data{}, m_size{}, m_buf{}
+{
+#ifdef MKMZ_MAPPED
+	int fd = open(name.c_str(), O_RDONLY);
+	if (fd == -1)
+		throw std::runtime_error("Couldn't open " + name);
+
+	struct stat st{};
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		throw std::runtime_error("Couldn't read " + name);
+	}
+	m_size = static_cast<std::size_t>(st.st_size);
+
+	// an empty mapping isn't allowed
+	if (m_size)
+	{
+		void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("Couldn't map " + name);
+		}
+		m_data = static_cast<const unsigned char *>(p);
+	}
+	// the mapping keeps the file open
+	close(fd);
+#else
+	std::ifstream in(name, std::ios::binary | std::ios::ate);
+	if (!in)
+		throw std::runtime_error("Couldn't open " + name);
+	m_size = static_cast<std::size_t>(in.tellg());
+	m_buf.resize(m_size);
+	in.seekg(0);
+	if (!in.read(reinterpret_cast<char *>(m_buf.data()), static_cast<std::streamsize>(m_size)))
+		throw std::runtime_error("Couldn't read " + name);
+	m_data = m_buf.data();
+#endif
+}
+
+mapped::file::~file()
+{
+#ifdef MKMZ_MAPPED
+	if (m_data)
+		munmap(const_cast<unsigned char *>(m_data), m_size);
+#endif
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// big buffers can be kept in memory mapped files instead of ram, so the os can page them out and mazes aren't limited by physical memory
+// nothing is mapped until a directory is set, and only buffers of at least min_size bytes are mapped after that
+namespace mapped
+{
+    // how a buffer is going to be accessed, passed on to the os as a hint
+    enum class access
+    {
+        normal,
+        // read or written front to back, or used as a stack
+        sequential,
+        random,
+    };
+
+    constexpr std::size_t min_size = std::size_t{1} << 24;
+
+    // false if files can't be mapped on this platform
+    bool supported();
+
+    // dir has to exist, the files are removed as soon as they're created so nothing is left behind
+    // an empty dir keeps everything in ram
+    // only set it while no buffers are allocated, buffers are freed according to the directory at the time
+    void set_directory(const std::string &dir);
+    const std::string &directory();
+
+    void *allocate(std::size_t bytes, access hint);
+    void deallocate(void *p, std::size_t bytes);
+
+    // does nothing for buffers that aren't mapped
+    void advise(const void *p, std::size_t bytes, access hint);
+
+    // a whole file mapped read only, so it's only read as it's used
+    // read into ram where files can't be mapped, and mapped whether or not a directory is set
+    class file
+    {
+    public:
+        // throws std::runtime_error if name can't be opened or read
+        explicit file(const std::string &name);
+        ~file();
+
+        file(const file &) = delete;
+        file &operator=(const file &) = delete;
+
+        // at least 8 byte aligned
+        inline const unsigned char *data() const { return m_data; }
+        inline std::size_t size() const { return m_size; }
+
+    private:
+        const unsigned char *m_data;
+        std::size_t m_size;
+        // where the file is read into when it isn't mapped
+        std::vector<unsigned char> m_buf;
+    };
+}
+
+template <typename T, mapped::access hint = mapped::access::normal>
+struct mapped_allocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = mapped_allocator<U, hint>;
+    };
+
+    mapped_allocator() = default;
+    template <typename U>
+    mapped_allocator(const mapped_allocator<U, hint> &) {}
+
+    inline T *allocate(std::size_t n) { return static_cast<T *>(mapped::allocate(n * sizeof(T), hint)); }
+    inline void deallocate(T *p, std::size_t n) { mapped::deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const mapped_allocator<U, hint> &) const { return true; }
+};
+
+template <typename T, mapped::access hint = mapped::access::normal>
+using mapped_vector = std::vector<T, mapped_allocator<T, hint>>;
@@ -1,12 +1,18 @@
 #include "maze.h"
+#include "thread_pool.h"
+#include "ellers.h"
+#include "progress.h"
 
 #include <random>
 
 #include <thread>
-#include <chrono>
 
-#include <unordered_map>
-#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 
 constexpr char opposite(char d)
 {
@@ -36,198 +42,580 @@ void move(pt &p, maze::direction dir)
 	}
 }
 
-// i think it should be passed by value, not 100% sure though
-void progress_thread(std::function<void(double)> callback, maze::len_t &cur_top, maze::len_t total)
-{
-	using namespace std::chrono_literals;
-
-	maze::len_t last = -1;
-
-	do
-	{
-		if (cur_top != last)
-			callback(static_cast<double>(cur_top) / total);
-		std::this_thread::sleep_for(100ms);
-	} while (cur_top != total);
-
-	callback(1.0);
-}
-
 constexpr char tc(maze::direction d)
 {
 	return static_cast<char>(d);
 }
 
-struct pt_hash
-{
-	std::size_t operator()(pt pt) const
-	{
-		return (486187739 + pt.y) * 486187739 + pt.x;
-	}
-};
-
 struct end_pt
 {
+	pt p;
 	maze::len_t final_distance;
 	maze::len_t choice_count;
 
-	end_pt() : final_distance{0}, choice_count{0} {}
+	end_pt() : p{}, final_distance{0}, choice_count{0} {}
 };
 
-struct connection
+// every cell on the edge of the maze, in order starting from 0, 0 going right along the bottom and then counterclockwise
+struct maze::perimeter
 {
-	connection(maze::len_t width, maze::len_t height) : end{(width + height) * 2 - 4}
+	perimeter(maze::len_t width, maze::len_t height) : width{width}, height{height}, end(std::max<maze::len_t>(1, (width + height) * 2 - 4))
 	{
-		// width + height - 1 + width - 1 + height - 1 - 1 = (width + height) * 2 - 4
-		pt cur{0, 0};
-		for (; cur.x < width; ++cur.x)
-			end.emplace(cur, end_pt{});
-		--cur.x;
-		for (++cur.y; cur.y < height; ++cur.y)
-			end.emplace(cur, end_pt{});
-		--cur.y;
-		for (--cur.x; cur.x != static_cast<maze::len_t>(-1); --cur.x)
-			end.emplace(cur, end_pt{});
-		++cur.x;
-		if (cur.y)
-			for (--cur.y; cur.y != 0; --cur.y)
-				end.emplace(cur, end_pt{});
+		for (pt cur{0, 0}; cur.x < width; ++cur.x)
+			end[index(cur)].p = cur;
+		for (pt cur{width - 1, 0}; cur.y < height; ++cur.y)
+			end[index(cur)].p = cur;
+		for (pt cur{0, height - 1}; cur.x < width; ++cur.x)
+			end[index(cur)].p = cur;
+		for (pt cur{0, 0}; cur.y < height; ++cur.y)
+			end[index(cur)].p = cur;
 	}
 
-	~connection() = default;
+	inline bool contains(pt p) const
+	{
+		return p.x == 0 || p.y == 0 || p.x == width - 1 || p.y == height - 1;
+	}
 
-	std::unordered_map<pt, end_pt, pt_hash> end;
+	// p has to be on the edge
+	inline maze::len_t index(pt p) const
+	{
+		if (p.y == 0)
+			return p.x;
+		if (p.x == width - 1)
+			return width - 1 + p.y;
+		if (p.y == height - 1)
+			return width - 1 + height - 1 + width - 1 - p.x;
+		// the left side wraps around to 0, 0
+		return (width - 1 + height - 1 + width - 1 + height - 1 - p.y) % end.size();
+	}
+
+	maze::len_t width, height;
+	std::vector<end_pt> end;
 };
 
-template <maze::len_t n>
-bool maze::explore_n(pt p, maze::direction dir) const
+// a branch only counts as a choice if it's at least this many cells deeper than where it starts
+constexpr std::uint8_t reasonable_depth = 9;
+
+constexpr std::uint8_t dir_bit(maze::direction d)
 {
-	move(p, dir);
+	return d == maze::direction::none ? 0 : static_cast<std::uint8_t>(1 << tc(d));
+}
 
-	direction prev_opp_dir = opposite(dir);
-	
-	if (direction::up != prev_opp_dir && p.y < m_height - 1 && get_wall(p, direction::up) == state::open &&	explore_n<n - 1>(p, direction::up))
-		return true;
-	
-	if (direction::right != prev_opp_dir && p.x < m_width - 1 && get_wall(p, direction::right) == state::open && explore_n<n - 1>(p, direction::right))
-		return true;
-	
-	if (direction::down != prev_opp_dir && p.y && get_wall(p, direction::down) == state::open && explore_n<n - 1>(p, direction::down))
-		return true;
-	
-	if (direction::left != prev_opp_dir && p.x && get_wall(p, direction::left) == state::open && explore_n<n - 1>(p, direction::left))
-		return true;
+// depth first search over the part of the tree that open lets it into, starting from start and never going back the way it came
+// the maze is a tree, so nothing has to remember where the search has already been
+// enter(p, back, distance) is called when p is reached, back being the way it came from and distance the number of steps from start
+// whatever enter returns (at most 6 bits) is given back to leave(p, data) once everything past p is done
+template <typename Open, typename Enter, typename Leave>
+void walk_tree(const Open &open, pt start, maze::direction back, Enter &&enter, Leave &&leave)
+{
+	// direction every cell was entered in, in the low 2 bits, and its parent's data
+	mapped_vector<std::uint8_t, mapped::access::sequential> stack;
 
-	return false;
-}
+	pt p = start;
+	std::uint8_t data = enter(p, back, 0);
+	char next = 0;
+	while (true)
+	{
+		maze::direction cur_back = stack.empty() ? back : opposite(static_cast<maze::direction>(stack.back() & 3));
+		for (; next < 4; ++next)
+			if (static_cast<maze::direction>(next) != cur_back && open(p, static_cast<maze::direction>(next)))
+				break;
+
+		if (next < 4)
+		{
+			auto dir = static_cast<maze::direction>(next);
+			stack.push_back(static_cast<std::uint8_t>(next | (data << 2)));
+			move(p, dir);
+			data = enter(p, opposite(dir), static_cast<maze::len_t>(stack.size()));
+			next = 0;
+			continue;
+		}
+
+		leave(p, data);
+
+		if (stack.empty())
+			return;
+
+		auto dir = static_cast<maze::direction>(stack.back() & 3);
+		data = stack.back() >> 2;
+		stack.pop_back();
 
-template <>
-bool maze::explore_n<1>(pt p, maze::direction dir) const
-{	
-	return true;
+		move(p, opposite(dir));
+		next = tc(dir) + 1;
+	}
 }
 
-maze::len_t maze::get_num_available(pt p, maze::direction prev_opp) const
+void maze::find_exits()
 {
-	len_t available = 0;
-	if (prev_opp != direction::up && p.y < m_height - 1 && get_wall(p, direction::up) == state::open && explore_n<10>(p, direction::up))
-		++available;
-	if (prev_opp != direction::right && p.x < m_width - 1 && get_wall(p, direction::right) == state::open && explore_n<10>(p, direction::right))
-		++available;
-	if (prev_opp != direction::down && p.y && get_wall(p, direction::down) == state::open && explore_n<10>(p, direction::down))
-		++available;
-	if (prev_opp != direction::left && p.x && get_wall(p, direction::left) == state::open && explore_n<10>(p, direction::left))
-		++available;
-	
-	return available;
+	if (!cell_words())
+		throw std::runtime_error("No maze generated");
+
+	progress_reporter prog(progress, m_width * m_height, m_pool);
+	find_exits(prog);
 }
 
-void maze::find_exits(len_t &count)
+void maze::find_exits(progress_reporter &prog)
 {
-	len_t total = m_width * m_height;
+	perimeter entrance(m_width, m_height);
 
-	// find exits
-	connection entrance(m_width, m_height);
+	// strips are big enough that their edges are a small part of them, and small enough that distances within them fit in 32 bits
+	len_t strip_rows = std::max<len_t>(64, (len_t{1} << 24) / m_width);
+	if (m_pool && m_pool->size() > 1 && strip_rows < m_height && m_width < (len_t{1} << 22))
+		analyse_strips(prog, entrance, strip_rows);
+	else
+		analyse(prog, entrance);
 
-	pt p_init = {0, 0};
-	pt p = p_init;
+	// ties go to whichever comes first along the edge
+	auto max = entrance.end.begin();
+	double max_factor = 0;
+	for (auto it = entrance.end.begin(); it != entrance.end.end(); ++it)
+	{
+		double factor = .95 * std::log(it->choice_count + 1) + .05 * std::log(it->final_distance + 1);
+		if (factor > max_factor)
+		{
+			max = it;
+			max_factor = factor;
+		}
+	}
 
-	std::vector<direction> stack;
-	std::vector<len_t> choice_stack;
-	std::vector<bool> visited(total);
+	m_difficulty = max_factor;
+
+	m_entrance = {};
+	m_exit = max->p;
+
+	m_solution_branch_count = max->choice_count;
+	m_solution_distance = max->final_distance;
+}
+
+bool maze::passage(pt p, direction dir) const
+{
+	switch (dir)
+	{
+	case direction::up:
+		if (p.y == m_height - 1)
+			return false;
+		break;
+	case direction::right:
+		if (p.x == m_width - 1)
+			return false;
+		break;
+	case direction::down:
+		if (!p.y)
+			return false;
+		break;
+	default:
+		if (!p.x)
+			return false;
+	}
+	return get_wall(p, dir) == state::open;
+}
 
-	len_t i = 1;
-	++count;
+maze::len_t maze::branch_depth(pt p, direction dir, len_t cap) const
+{
+	move(p, dir);
+	if (!cap)
+		return 0;
+
+	len_t depth = 0;
+	for (char d = 0; d < 4 && depth < cap; ++d)
+		if (static_cast<direction>(d) != opposite(dir) && passage(p, static_cast<direction>(d)))
+			depth = std::max(depth, branch_depth(p, static_cast<direction>(d), cap - 1) + 1);
+	return depth;
+}
 
-	len_t cur_choice = get_num_available(p, direction::none);
-	len_t choice_count = cur_choice > 1 ? cur_choice : 0;
+void maze::analyse(progress_reporter &prog, perimeter &entrance) const
+{
+	auto open = [this](pt p, direction dir) { return passage(p, dir); };
 
-	len_t distance = 0;
-	do
+	// first pass finds the depth of every branch, capped at reasonable_depth, and marks the cells whose branches are deep enough
+	mapped_vector<bool> reasonable(cell_count());
 	{
-		direction dir;
-		
-		if (p.y < m_height - 1 && !visited[(p.y + 1) * m_width + p.x] && get_wall(p, direction::up) == state::open)
-			dir = direction::up;
-		else if (p.x < m_width - 1 && !visited[p.y * m_width + p.x + 1] && get_wall(p, direction::right) == state::open)
-			dir = direction::right;
-		else if (p.y && !visited[(p.y - 1) * m_width + p.x] && get_wall(p, direction::down) == state::open)
-			dir = direction::down;
-		else if (p.x && !visited[p.y * m_width + p.x - 1] && get_wall(p, direction::left) == state::open)
-			dir = direction::left;
-		else
+		// every frame is the direction a cell was entered in, in the low 2 bits, plus the depth found so far below its parent
+		mapped_vector<std::uint8_t, mapped::access::sequential> stack;
+		pt p{0, 0};
+		char next = 0;
+		// depth of the branch below p found so far
+		std::uint8_t depth = 0;
+		while (true)
 		{
-			choice_count -= choice_stack.back();
+			direction back = stack.empty() ? direction::none : opposite(static_cast<direction>(stack.back() & 3));
+			for (; next < 4; ++next)
+				if (static_cast<direction>(next) != back && open(p, static_cast<direction>(next)))
+					break;
 
-			move(p, opposite(stack.back()));
-			stack.pop_back();
-			choice_stack.pop_back();
-			--distance;
+			if (next < 4)
+			{
+				stack.push_back(static_cast<std::uint8_t>(next | (depth << 2)));
+				move(p, static_cast<direction>(next));
+				next = 0;
+				depth = 0;
+				continue;
+			}
 
-			continue;
-		}
-		
+			if (depth >= reasonable_depth)
+				reasonable[cell_index(p)] = true;
 
-		move(p, dir);
-		stack.push_back(dir);
+			if (stack.empty())
+				break;
 
-		++count;
-		++i;
-		++distance;
+			direction dir = static_cast<direction>(stack.back() & 3);
+			std::uint8_t parent_depth = stack.back() >> 2;
+			stack.pop_back();
 
-		cur_choice = get_num_available(p, opposite(dir));
-		choice_stack.push_back(cur_choice > 1 ? cur_choice : 0);
-		choice_count += choice_stack.back();
+			move(p, opposite(dir));
+			depth = std::max<std::uint8_t>(parent_depth, std::min<std::uint8_t>(depth + 1, reasonable_depth));
+			next = tc(dir) + 1;
+		}
+	}
 
-		visited[p.y * m_width + p.x] = true;
+	// second pass adds up the distance and choices along the way to every cell on the edge
+	len_t choice_count = 0;
+	// cells not added to prog yet
+	len_t done = 0;
+	walk_tree(open, {0, 0}, direction::none, [&](pt p, direction back, len_t distance) {
+		// number of branches p leads into that are worth counting, excluding the way it came from
+		len_t available = 0;
+		for (char d = 0; d < 4; ++d)
+		{
+			pt n = p;
+			if (static_cast<direction>(d) != back && open(p, static_cast<direction>(d)) && (move(n, static_cast<direction>(d)), reasonable[cell_index(n)]))
+				++available;
+		}
+		len_t cur_choice = available > 1 ? available : 0;
+		choice_count += cur_choice;
+		if (++done == 1 << 12)
+		{
+			prog.add(done);
+			done = 0;
+		}
 
-		if (p.x == 0 || p.y == 0 || p.x == m_width - 1 || p.y == m_height - 1)
+		if (distance && entrance.contains(p))
 		{
-			auto &end_pt = entrance.end.find(p)->second;
+			auto &end_pt = entrance.end[entrance.index(p)];
 			end_pt.final_distance = distance;
 			end_pt.choice_count = choice_count;
 		}
-	} while (i < total);
 
-	auto max = entrance.end.begin();
-	double max_factor = 0;
-	for (auto it = entrance.end.begin(); it != entrance.end.end(); ++it)
+		return static_cast<std::uint8_t>(cur_choice);
+	}, [&](pt, std::uint8_t cur_choice) {
+		choice_count -= cur_choice;
+	});
+
+	prog.add(done);
+}
+
+// fills out with one byte for every cell in rows [first, last), the open walls of the cell are set in the low 4 bits
+void get_passages(const maze &mz, maze::len_t first, maze::len_t last, std::uint8_t *out)
+{
+	maze::len_t words = (mz.width() + 63) / 64;
+	std::vector<std::uint64_t> up(words), right(words), below(words), unused(words);
+	if (first)
+		mz.get_row(first - 1, below.data(), unused.data());
+
+	auto bit = [](const std::vector<std::uint64_t> &bits, maze::len_t x) { return (bits[x / 64] >> (x % 64)) & 1; };
+
+	for (maze::len_t y = first; y < last; ++y)
 	{
-		double factor = .95 * std::log(it->second.choice_count + 1) + .05 * std::log(it->second.final_distance + 1);
-		if (factor > max_factor)
+		mz.get_row(y, up.data(), right.data());
+		for (maze::len_t x = 0; x < mz.width(); ++x)
 		{
-			max = it;
-			max_factor = factor;
+			std::uint8_t cell = 0;
+			if (y + 1 < mz.height() && bit(up, x))
+				cell |= dir_bit(maze::direction::up);
+			if (x + 1 < mz.width() && bit(right, x))
+				cell |= dir_bit(maze::direction::right);
+			if (y && bit(below, x))
+				cell |= dir_bit(maze::direction::down);
+			if (x && bit(right, x - 1))
+				cell |= dir_bit(maze::direction::left);
+			*out++ = cell;
 		}
+		std::swap(up, below);
 	}
+}
 
-	m_difficulty = max_factor;
+// part of the maze tree that lies within one strip
+struct strip_component
+{
+	// first cell of the component reached from the entrance
+	pt entry;
+	// way back to the component closer to the entrance, none for the entrance's own component
+	maze::direction back;
+};
 
-	m_entrance = {};
-	m_exit = max->first;
+void maze::analyse_strips(progress_reporter &prog, perimeter &entrance, len_t strip_rows) const
+{
+	// every strip is analysed on its own, from where the path from the entrance first enters each part of the tree it holds
+	// the results for the parts are then chained together in the order the path reaches them
+	struct strip
+	{
+		len_t first, last;
+		// parts of the tree within the strip
+		len_t component_count;
+		// index of the strip's first component among all of them
+		len_t component_offset;
+
+		// component, distance from the component's entry and choices since it, for every cell of the first and last rows
+		std::vector<std::uint32_t> first_component, last_component;
+		std::vector<std::uint32_t> first_distance, last_distance;
+		std::vector<std::uint32_t> first_choices, last_choices;
+	};
+
+	len_t strip_count = (m_height + strip_rows - 1) / strip_rows;
+	std::vector<strip> strips(strip_count);
+	for (len_t s = 0; s < strip_count; ++s)
+	{
+		strips[s].first = s * strip_rows;
+		strips[s].last = std::min(m_height, strips[s].first + strip_rows);
+	}
+
+	// find the components of every strip
+	m_pool->parallel_for(0, strip_count, 1, [&](len_t begin, len_t end) {
+		for (len_t s = begin; s < end; ++s)
+		{
+			strip &st = strips[s];
+			std::vector<std::uint8_t> cells((st.last - st.first) * m_width);
+			get_passages(*this, st.first, st.last, cells.data());
+
+			// high bit is set once the cell is in a component
+			constexpr std::uint8_t seen = 0x80;
+			auto cell = [&](pt p) -> std::uint8_t & { return cells[(p.y - st.first) * m_width + p.x]; };
+			auto open = [&](pt p, direction d) {
+				return (cell(p) & dir_bit(d)) && !(d == direction::up && p.y + 1 == st.last) && !(d == direction::down && p.y == st.first);
+			};
+
+			st.first_component.resize(m_width);
+			st.last_component.resize(m_width);
+
+			std::uint32_t component = 0;
+			for (pt p{0, st.first}; p.y < st.last; ++p.y)
+				for (p.x = 0; p.x < m_width; ++p.x)
+				{
+					if (cell(p) & seen)
+						continue;
+
+					walk_tree(open, p, direction::none, [&](pt c, direction, len_t) {
+						cell(c) |= seen;
+						if (c.y == st.first)
+							st.first_component[c.x] = component;
+						if (c.y + 1 == st.last)
+							st.last_component[c.x] = component;
+						return std::uint8_t{0};
+					}, [](pt, std::uint8_t) {});
+					++component;
+				}
+
+			st.component_count = component;
+		}
+	});
+
+	len_t component_count = 0;
+	for (auto &st : strips)
+	{
+		st.component_offset = component_count;
+		component_count += st.component_count;
+	}
+
+	// passages between strips connect their components into a tree
+	// every one is stored as the x of the passage and the row below it
+	std::vector<len_t> link_offsets(component_count + 1);
+	std::vector<pt> links;
+	{
+		struct link
+		{
+			len_t lower, upper;
+			pt p;
+		};
+		std::vector<link> all;
+
+		len_t words = (m_width + 63) / 64;
+		std::vector<std::uint64_t> up(words), right(words);
+		for (len_t s = 0; s + 1 < strip_count; ++s)
+		{
+			len_t y = strips[s].last - 1;
+			get_row(y, up.data(), right.data());
+			for (len_t x = 0; x < m_width; ++x)
+				if ((up[x / 64] >> (x % 64)) & 1)
+				{
+					all.push_back({strips[s].component_offset + strips[s].last_component[x], strips[s + 1].component_offset + strips[s + 1].first_component[x], {x, y}});
+					++link_offsets[all.back().lower + 1];
+					++link_offsets[all.back().upper + 1];
+				}
+		}
+
+		for (len_t c = 0; c < component_count; ++c)
+			link_offsets[c + 1] += link_offsets[c];
+
+		links.resize(link_offsets.back());
+		std::vector<len_t> fill(link_offsets.begin(), link_offsets.end() - 1);
+		for (auto &l : all)
+		{
+			links[fill[l.lower]++] = l.p;
+			links[fill[l.upper]++] = l.p;
+		}
+	}
+
+	auto component_of = [&](pt p) {
+		const strip &st = strips[p.y / strip_rows];
+		return st.component_offset + (p.y == st.first ? st.first_component[p.x] : st.last_component[p.x]);
+	};
+
+	// breadth first search from the entrance's component finds where the path enters every other one
+	std::vector<strip_component> components(component_count);
+	std::vector<len_t> order;
+	order.reserve(component_count);
+	{
+		std::vector<bool> reached(component_count);
+		len_t root = component_of({0, 0});
+		components[root] = {{0, 0}, direction::none};
+		reached[root] = true;
+		order.push_back(root);
+
+		for (len_t i = 0; i < order.size(); ++i)
+		{
+			len_t c = order[i];
+			for (len_t l = link_offsets[c]; l < link_offsets[c + 1]; ++l)
+			{
+				pt lower = links[l];
+				pt upper{lower.x, lower.y + 1};
+
+				len_t other;
+				strip_component next;
+				if (component_of(lower) == c)
+				{
+					other = component_of(upper);
+					next = {upper, direction::down};
+				}
+				else
+				{
+					other = component_of(lower);
+					next = {lower, direction::up};
+				}
+
+				if (reached[other])
+					continue;
+				reached[other] = true;
+				components[other] = next;
+				order.push_back(other);
+			}
+		}
+	}
+
+	// component every cell on the edge was reached in
+	std::vector<len_t> end_components(entrance.end.size(), component_count);
+
+	// walk every component from its entry
+	m_pool->parallel_for(0, strip_count, 1, [&](len_t begin, len_t end) {
+		for (len_t s = begin; s < end; ++s)
+		{
+			strip &st = strips[s];
+
+			std::vector<std::uint8_t> cells((st.last - st.first) * m_width);
+			get_passages(*this, st.first, st.last, cells.data());
 
-	m_solution_branch_count = max->second.choice_count;
-	m_solution_distance = max->second.final_distance;
+			auto cell = [&](pt p) -> std::uint8_t & { return cells[(p.y - st.first) * m_width + p.x]; };
+			auto open = [&](pt p, direction d) {
+				return (cell(p) & dir_bit(d)) && !(d == direction::up && p.y + 1 == st.last) && !(d == direction::down && p.y == st.first);
+			};
+
+			// first pass marks the walls that lead into deep enough branches in the high 4 bits, like analyse
+			// branches that leave the strip are explored directly, they never need more than reasonable_depth cells
+			for (len_t c = st.component_offset; c < st.component_offset + st.component_count; ++c)
+			{
+				// depth of the branch below every cell on the way found so far
+				std::vector<std::uint8_t> depths;
+				walk_tree(open, components[c].entry, components[c].back, [&](pt, direction back, len_t) {
+					depths.push_back(0);
+					return static_cast<std::uint8_t>(back == direction::none ? 4 : tc(back));
+				}, [&](pt p, std::uint8_t data) {
+					std::uint8_t depth = depths.back();
+					depths.pop_back();
+
+					auto back = data == 4 ? direction::none : static_cast<direction>(data);
+					for (direction d : {direction::up, direction::down})
+						if (d != back && (cell(p) & dir_bit(d)) && !open(p, d))
+						{
+							std::uint8_t branch = static_cast<std::uint8_t>(branch_depth(p, d, reasonable_depth));
+							if (branch >= reasonable_depth)
+								cell(p) |= dir_bit(d) << 4;
+							depth = std::max<std::uint8_t>(depth, std::min<std::uint8_t>(branch + 1, reasonable_depth));
+						}
+
+					if (depths.empty())
+						return;
+
+					if (depth >= reasonable_depth)
+					{
+						pt parent = p;
+						move(parent, back);
+						cell(parent) |= dir_bit(opposite(back)) << 4;
+					}
+					depths.back() = std::max<std::uint8_t>(depths.back(), std::min<std::uint8_t>(depth + 1, reasonable_depth));
+				});
+			}
+
+			st.first_distance.resize(m_width);
+			st.last_distance.resize(m_width);
+			st.first_choices.resize(m_width);
+			st.last_choices.resize(m_width);
+
+			for (len_t c = st.component_offset; c < st.component_offset + st.component_count; ++c)
+			{
+				std::uint32_t choice_count = 0;
+				walk_tree(open, components[c].entry, components[c].back, [&](pt p, direction back, len_t distance) {
+					auto available = std::popcount(static_cast<unsigned int>((cell(p) >> 4) & ~dir_bit(back) & 0xf));
+					std::uint32_t cur_choice = available > 1 ? available : 0;
+					choice_count += cur_choice;
+
+					if (p.y == st.first)
+					{
+						st.first_distance[p.x] = static_cast<std::uint32_t>(distance);
+						st.first_choices[p.x] = choice_count;
+					}
+					if (p.y + 1 == st.last)
+					{
+						st.last_distance[p.x] = static_cast<std::uint32_t>(distance);
+						st.last_choices[p.x] = choice_count;
+					}
+					if (entrance.contains(p) && p != pt{0, 0})
+					{
+						len_t i = entrance.index(p);
+						entrance.end[i].final_distance = distance;
+						entrance.end[i].choice_count = choice_count;
+						end_components[i] = c;
+					}
+
+					return static_cast<std::uint8_t>(cur_choice);
+				}, [&](pt, std::uint8_t cur_choice) {
+					choice_count -= cur_choice;
+				});
+			}
+
+			prog.add((st.last - st.first) * m_width);
+		}
+	});
+
+	// distance and choices up to every component's entry, following the order the path reaches them in
+	std::vector<len_t> base_distance(component_count), base_choices(component_count);
+	for (len_t i = 1; i < order.size(); ++i)
+	{
+		len_t c = order[i];
+		pt from = components[c].entry;
+		move(from, components[c].back);
+
+		const strip &st = strips[from.y / strip_rows];
+		len_t parent = component_of(from);
+		bool first = from.y == st.first;
+		base_distance[c] = base_distance[parent] + (first ? st.first_distance[from.x] : st.last_distance[from.x]) + 1;
+		base_choices[c] = base_choices[parent] + (first ? st.first_choices[from.x] : st.last_choices[from.x]);
+	}
+
+	for (len_t i = 0; i < entrance.end.size(); ++i)
+		if (end_components[i] != component_count)
+		{
+			entrance.end[i].final_distance += base_distance[end_components[i]];
+			entrance.end[i].choice_count += base_choices[end_components[i]];
+		}
 }
 
 void maze::set_seed()
@@ -248,33 +636,30 @@ void maze::gen_recursive_backtracker()
 {
 	alloc(state::closed);
 
-	len_t cur_top = 1;
-	len_t len = m_width * m_height;
-
-	std::jthread progress_task;
-	if (progress)
-		progress_task = std::jthread(progress_thread, progress, std::ref(cur_top), len * 2);
+	progress_reporter prog(progress, m_width * m_height * 2, m_pool);
+	// cells not added to prog yet
+	len_t done = 1;
 
 	{
 		std::mt19937 gen(get_seed());
 		pt p{std::uniform_int_distribution<len_t>(0, m_width - 1)(gen), std::uniform_int_distribution<len_t>(0, m_height - 1)(gen)};
 		pt p_init = p;
 
-		std::vector<direction> stack;
+		mapped_vector<direction, mapped::access::sequential> stack;
 		// use bitset to track which is visited
-		std::vector<bool> visited(len, 0);
-		visited[p.y * m_width + p.x] = true;
+		mapped_vector<bool> visited(cell_count(), 0);
+		visited[cell_index(p)] = true;
 		do
 		{
 			direction available[4];
 			len_t num_available = 0;
-			if (p.y < m_height - 1 && !visited[(p.y + 1) * m_width + p.x])
+			if (p.y < m_height - 1 && !visited[cell_index({p.x, p.y + 1})])
 				available[num_available++] = direction::up;
-			if (p.x < m_width - 1 && !visited[p.y * m_width + p.x + 1])
+			if (p.x < m_width - 1 && !visited[cell_index({p.x + 1, p.y})])
 				available[num_available++] = direction::right;
-			if (p.y && !visited[(p.y - 1) * m_width + p.x])
+			if (p.y && !visited[cell_index({p.x, p.y - 1})])
 				available[num_available++] = direction::down;
-			if (p.x && !visited[p.y * m_width + p.x - 1])
+			if (p.x && !visited[cell_index({p.x - 1, p.y})])
 				available[num_available++] = direction::left;
 
 			// if there's a cell available to move into
@@ -285,9 +670,13 @@ void maze::gen_recursive_backtracker()
 				set_wall<state::open>(p, cur_dir);
 				move(p, cur_dir);
 
-				++cur_top;
+				if (++done == 1 << 12)
+				{
+					prog.add(done);
+					done = 0;
+				}
 
-				visited[p.y * m_width + p.x] = true;
+				visited[cell_index(p)] = true;
 
 				stack.push_back(cur_dir);
 			}
@@ -300,84 +689,482 @@ void maze::gen_recursive_backtracker()
 		} while (p != p_init);
 	}
 
-	find_exits(cur_top);
+	prog.add(done);
+	find_exits(prog);
 }
 
-void maze::gen_wilsons()
+// sides of the tiles the parallel backtracker works on, tiles at the edges take up the rest
+constexpr maze::len_t backtracker_tile_size = 1 << 10;
+
+void maze::backtrack(rect r, std::mt19937 &gen, progress_reporter &prog)
 {
-	alloc(state::closed);
+	auto local = [&](pt p) { return (p.y - r.p.y) * r.width + (p.x - r.p.x); };
 
-	auto len = m_width * m_height;
+	std::vector<bool> visited(r.width * r.height);
+	std::vector<direction> stack;
 
-	std::unordered_map<pt, bool, pt_hash> grid(len);
-	std::unordered_set<pt, pt_hash> available(len);
-	for (pt p{0, 0}; p.x < m_width; ++p.x)
-		for (p.y = 0; p.y < m_height; ++p.y)
-			available.insert(p);
+	pt p{r.p.x + std::uniform_int_distribution<len_t>(0, r.width - 1)(gen), r.p.y + std::uniform_int_distribution<len_t>(0, r.height - 1)(gen)};
+	visited[local(p)] = true;
+	len_t done = 1;
 
-	std::mt19937 gen(get_seed());
+	for (;;)
+	{
+		direction available[4];
+		len_t num_available = 0;
+		if (p.y + 1 < r.p.y + r.height && !visited[local({p.x, p.y + 1})])
+			available[num_available++] = direction::up;
+		if (p.x + 1 < r.p.x + r.width && !visited[local({p.x + 1, p.y})])
+			available[num_available++] = direction::right;
+		if (p.y > r.p.y && !visited[local({p.x, p.y - 1})])
+			available[num_available++] = direction::down;
+		if (p.x > r.p.x && !visited[local({p.x - 1, p.y})])
+			available[num_available++] = direction::left;
+
+		if (num_available)
+		{
+			direction cur_dir = available[std::uniform_int_distribution<len_t>(0, num_available - 1)(gen)];
 
-	std::uniform_int_distribution<len_t> x_dist(0, m_width - 1);
-	std::uniform_int_distribution<len_t> y_dist(0, m_height - 1);
+			// the tile next to this one may be using the same words
+			set_wall_shared<state::open>(p, cur_dir);
+			move(p, cur_dir);
+			visited[local(p)] = true;
+			stack.push_back(cur_dir);
 
-	len_t finished = 1;
-	std::jthread progress_task;
-	if (progress)
-		progress_task = std::jthread(progress_thread, progress, std::ref(finished), len * 2);
-	
-	// initial
-	{
-		pt first{x_dist(gen), y_dist(gen)};
-		grid[first] = true;
-		available.erase(first);
+			if (++done == 1 << 12)
+			{
+				prog.add(done);
+				done = 0;
+			}
+		}
+		else
+		{
+			if (stack.empty())
+				break;
+			move(p, opposite(stack.back()));
+			stack.pop_back();
+		}
 	}
 
-	while (finished < len)
+	prog.add(done);
+}
+
+void maze::gen_parallel_backtracker()
+{
+	alloc(state::closed);
+
+	progress_reporter prog(progress, m_width * m_height * 2, m_pool);
+
+	auto seed = static_cast<std::uint32_t>(get_seed());
+
+	// the tiles don't depend on the number of threads, so neither does the maze
+	len_t tiles_x = std::max<len_t>(1, m_width / backtracker_tile_size);
+	len_t tiles_y = std::max<len_t>(1, m_height / backtracker_tile_size);
+	auto tile = [&](pt t) {
+		len_t x = t.x * m_width / tiles_x;
+		len_t y = t.y * m_height / tiles_y;
+		return rect{{x, y}, (t.x + 1) * m_width / tiles_x - x, (t.y + 1) * m_height / tiles_y - y};
+	};
+
+	auto task = [&](std::uint64_t first, std::uint64_t last) {
+		for (std::uint64_t t = first; t < last; ++t)
+		{
+			std::seed_seq seq{seed, 0u, static_cast<std::uint32_t>(t), static_cast<std::uint32_t>(t >> 32)};
+			std::mt19937 gen(seq);
+			backtrack(tile({t % tiles_x, t / tiles_x}), gen, prog);
+		}
+	};
+
+	if (m_pool)
+		m_pool->parallel_for(0, tiles_x * tiles_y, 1, task);
+	else
+		task(0, tiles_x * tiles_y);
+
+	// every tile is a maze of its own, a backtracker over the tiles joins them into one
+	// it opens one wall at random between every two tiles it moves between, so the tiles are joined like cells of a smaller maze
 	{
-		// walk
-		// choose random element from available
-		pt p_start = *std::next(available.begin(), std::uniform_int_distribution<std::size_t>(0, available.size() - 1)(gen));
-		pt p = p_start;
+		std::seed_seq seq{seed, 1u};
+		std::mt19937 gen(seq);
 
-		std::unordered_map<pt, direction, pt_hash> walk;
-		while (true)
+		std::vector<bool> visited(tiles_x * tiles_y);
+		std::vector<direction> stack;
+
+		pt t{std::uniform_int_distribution<len_t>(0, tiles_x - 1)(gen), std::uniform_int_distribution<len_t>(0, tiles_y - 1)(gen)};
+		visited[t.y * tiles_x + t.x] = true;
+
+		for (;;)
 		{
 			direction available[4];
 			len_t num_available = 0;
-			if (p.y < m_height - 1)
+			if (t.y + 1 < tiles_y && !visited[(t.y + 1) * tiles_x + t.x])
 				available[num_available++] = direction::up;
-			if (p.x < m_width - 1)
+			if (t.x + 1 < tiles_x && !visited[t.y * tiles_x + t.x + 1])
 				available[num_available++] = direction::right;
-			if (p.y)
+			if (t.y && !visited[(t.y - 1) * tiles_x + t.x])
 				available[num_available++] = direction::down;
-			if (p.x)
+			if (t.x && !visited[t.y * tiles_x + t.x - 1])
 				available[num_available++] = direction::left;
 
-			direction cur_dir = available[std::uniform_int_distribution<len_t>(0, num_available - 1)(gen)];
-			walk[p] = cur_dir;
+			if (num_available)
+			{
+				direction cur_dir = available[std::uniform_int_distribution<len_t>(0, num_available - 1)(gen)];
+
+				// the wall is opened from the tile below or left of it
+				pt from = t;
+				direction dir = cur_dir;
+				if (dir == direction::down || dir == direction::left)
+				{
+					move(from, dir);
+					dir = opposite(dir);
+				}
+
+				rect r = tile(from);
+				if (dir == direction::up)
+					set_wall<state::open>({r.p.x + std::uniform_int_distribution<len_t>(0, r.width - 1)(gen), r.p.y + r.height - 1}, direction::up);
+				else
+					set_wall<state::open>({r.p.x + r.width - 1, r.p.y + std::uniform_int_distribution<len_t>(0, r.height - 1)(gen)}, direction::right);
+
+				move(t, cur_dir);
+				visited[t.y * tiles_x + t.x] = true;
+				stack.push_back(cur_dir);
+			}
+			else
+			{
+				if (stack.empty())
+					break;
+				move(t, opposite(stack.back()));
+				stack.pop_back();
+			}
+		}
+	}
+
+	find_exits(prog);
+}
+
+void maze::gen_wilsons()
+{
+	alloc(state::closed);
+
+	progress_reporter prog(progress, m_width * m_height * 2, m_pool);
+
+	// half the memory for the list of remaining cells when the indices fit
+	if (m_width * m_height <= std::numeric_limits<std::uint32_t>::max())
+		wilsons<std::uint32_t>(prog);
+	else
+		wilsons<std::uint64_t>(prog);
 
-			if (grid[p])
+	find_exits(prog);
+}
+
+// state of a cell during wilson's algorithm
+// the low 2 bits are the direction the walk last left the cell in, later visits overwrite earlier ones which erases loops
+// in_maze is set once the cell is part of the maze
+// both are kept in the same byte so every step of a walk only touches one place in memory
+constexpr std::uint8_t in_maze = 4;
+
+template <typename index_t>
+void maze::wilsons(progress_reporter &prog)
+{
+	auto len = m_width * m_height;
+	// cells in the maze so far
+	len_t finished = 1;
+	prog.add(1);
+
+	// indexed by y * width + x, whatever the layout of the maze is
+	mapped_vector<std::uint8_t, mapped::access::random> cells(len);
+
+	// cells that might not be part of the maze yet
+	// cells that joined the maze are only removed once they're picked, so picking a cell is O(1)
+	mapped_vector<index_t, mapped::access::random> remaining(len);
+	for (len_t i = 0; i < len; ++i)
+		remaining[i] = static_cast<index_t>(i);
+
+	std::mt19937 gen(get_seed());
+
+	// every number from gen is good for 16 directions
+	std::uint32_t bits = 0;
+	int bits_left = 0;
+	auto random_dir = [&]() {
+		if (!bits_left)
+		{
+			bits = static_cast<std::uint32_t>(gen());
+			bits_left = 16;
+		}
+		auto d = static_cast<direction>(bits & 3);
+		bits >>= 2;
+		--bits_left;
+		return d;
+	};
+
+	// initial
+	{
+		pt first{std::uniform_int_distribution<len_t>(0, m_width - 1)(gen), std::uniform_int_distribution<len_t>(0, m_height - 1)(gen)};
+		cells[first.y * m_width + first.x] = in_maze;
+	}
+
+	while (finished < len)
+	{
+		// choose random cell that isn't part of the maze
+		len_t start;
+		while (true)
+		{
+			std::size_t i = std::uniform_int_distribution<std::size_t>(0, remaining.size() - 1)(gen);
+			start = remaining[i];
+
+			if (!(cells[start] & in_maze))
 				break;
-			
+
+			remaining[i] = remaining.back();
+			remaining.pop_back();
+		}
+
+		// walk
+		pt p{start % m_width, start / m_width};
+		len_t i = start;
+		while (!(cells[i] & in_maze))
+		{
+			// directions off the edge are drawn again, which keeps the others equally likely
+			direction cur_dir;
+			while (true)
+			{
+				cur_dir = random_dir();
+				if (cur_dir == direction::up ? p.y < m_height - 1 :
+					cur_dir == direction::right ? p.x < m_width - 1 :
+					cur_dir == direction::down ? p.y != 0 :
+					p.x != 0)
+					break;
+			}
+
+			cells[i] = static_cast<std::uint8_t>(cur_dir);
+
 			move(p, cur_dir);
+			switch (cur_dir)
+			{
+			case direction::up:
+				i += m_width;
+				break;
+			case direction::right:
+				++i;
+				break;
+			case direction::down:
+				i -= m_width;
+				break;
+			default:
+				--i;
+			}
 		}
 
 		// retrace walk and open cells
-		do
+		p = {start % m_width, start / m_width};
+		len_t walked = finished;
+		for (i = start; !(cells[i] & in_maze); ++finished)
 		{
-			grid[p_start] = true;
-			available.erase(p_start);
-			direction cur_dir = walk[p_start];
-			set_wall<state::open>(p_start, cur_dir);
-			move(p_start, cur_dir);
-			++finished;
-		} while (p_start != p);
+			direction cur_dir = static_cast<direction>(cells[i]);
+			cells[i] = in_maze;
+			set_wall<state::open>(p, cur_dir);
+			move(p, cur_dir);
+			i = p.y * m_width + p.x;
+		}
+		prog.add(finished - walked);
 	}
+}
+
+// splitmix64's mixing function, turns counters into numbers that look random
+constexpr std::uint64_t splitmix(std::uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+// parallel wilson's algorithm is done with cycle popping, which makes the same uniform spanning trees
+// every cell has an endless stack of random directions, and the directions on top point every cell to the next
+// loops that the top directions make are popped until there are none, and the tree that's left doesn't depend on the order they were popped in
+// the stacks are made from the seed, the cell and how deep they go, so the maze is the same for any number of walkers in any order
+
+// state of a cell is how many directions were popped off its stack, plus these flags
+constexpr std::uint32_t tree_flag = std::uint32_t{1} << 31;
+// set while a walker commits or pops the cell
+constexpr std::uint32_t lock_flag = std::uint32_t{1} << 30;
+constexpr std::uint32_t popped_mask = lock_flag - 1;
+
+template <typename index_t>
+void maze::parallel_wilsons(progress_reporter &prog)
+{
+	len_t len = m_width * m_height;
+	std::uint64_t seed = splitmix(get_seed() + 0x9e3779b97f4a7c15);
+
+	// indexed by y * width + x, whatever the layout of the maze is
+	mapped_vector<std::uint32_t, mapped::access::random> states(len);
+	// where the cell is in the path of the last walker that went through it
+	mapped_vector<index_t, mapped::access::random> positions(len);
+
+	// direction on top of the stack of cell i at p
+	// directions off the edge are skipped, which keeps the others equally likely
+	auto top = [&](len_t i, pt p, std::uint32_t popped) {
+		for (std::uint64_t h = splitmix(splitmix(seed ^ i) + popped);; h = splitmix(h))
+			for (int n = 0; n < 32; ++n, h >>= 2)
+			{
+				auto d = static_cast<direction>(h & 3);
+				if (d == direction::up ? p.y + 1 < m_height :
+					d == direction::right ? p.x + 1 < m_width :
+					d == direction::down ? p.y != 0 :
+					p.x != 0)
+					return d;
+			}
+	};
+
+	states[splitmix(seed) % len] = tree_flag;
+	prog.add(1);
+
+	struct step
+	{
+		index_t cell;
+		// state the walker found the cell in
+		std::uint32_t state;
+		direction dir;
+	};
+
+	// locks the cells of the steps as long as they're still in the state the walker found them in
+	auto lock = [&](step *first, step *last) {
+		for (step *s = first; s != last; ++s)
+		{
+			std::uint32_t expected = s->state;
+			if (!std::atomic_ref<std::uint32_t>(states[s->cell]).compare_exchange_strong(expected, expected | lock_flag, std::memory_order_acquire))
+			{
+				for (step *undo = first; undo != s; ++undo)
+					std::atomic_ref<std::uint32_t>(states[undo->cell]).store(undo->state, std::memory_order_release);
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// walks from start until it reaches the tree, and adds the walk to the tree
+	// if another walker changed a cell the walk went through first, it starts over
+	auto walk = [&](index_t start, std::vector<step> &path) {
+		path.clear();
+		index_t i = start;
+		pt p{start % m_width, start / m_width};
+
+		for (;;)
+		{
+			std::uint32_t s = std::atomic_ref<std::uint32_t>(states[i]).load(std::memory_order_acquire);
+			if (s & lock_flag)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			if (s & tree_flag)
+			{
+				if (!lock(path.data(), path.data() + path.size()))
+				{
+					path.clear();
+					i = start;
+					p = {start % m_width, start / m_width};
+					continue;
+				}
+
+				for (const step &st : path)
+					set_wall_shared<state::open>({st.cell % m_width, st.cell / m_width}, st.dir);
+				for (const step &st : path)
+					std::atomic_ref<std::uint32_t>(states[st.cell]).store(st.state | tree_flag, std::memory_order_release);
+				prog.add(path.size());
+				return;
+			}
+
+			index_t at = std::atomic_ref<index_t>(positions[i]).load(std::memory_order_relaxed);
+			if (at < path.size() && path[at].cell == i)
+			{
+				// walked into a loop, pop it and carry on from where it started
+				step *first = path.data() + at;
+				step *last = path.data() + path.size();
+				if (lock(first, last))
+				{
+					for (step *st = first; st != last; ++st)
+						std::atomic_ref<std::uint32_t>(states[st->cell]).store(st->state + 1, std::memory_order_release);
+					path.resize(at);
+				}
+				else
+				{
+					path.clear();
+					i = start;
+					p = {start % m_width, start / m_width};
+				}
+				continue;
+			}
+
+			direction d = top(i, p, s & popped_mask);
+			std::atomic_ref<index_t>(positions[i]).store(static_cast<index_t>(path.size()), std::memory_order_relaxed);
+			path.push_back({i, s, d});
+
+			move(p, d);
+			switch (d)
+			{
+			case direction::up:
+				i += static_cast<index_t>(m_width);
+				break;
+			case direction::right:
+				++i;
+				break;
+			case direction::down:
+				i -= static_cast<index_t>(m_width);
+				break;
+			default:
+				--i;
+			}
+		}
+	};
+
+	// every task walks from the cells in its range that aren't in the tree yet
+	auto task = [&](std::uint64_t first, std::uint64_t last) {
+		std::vector<step> path;
+		for (std::uint64_t i = first; i < last; ++i)
+			if (!(std::atomic_ref<std::uint32_t>(states[i]).load(std::memory_order_acquire) & tree_flag))
+				walk(static_cast<index_t>(i), path);
+	};
+
+	if (m_pool)
+		m_pool->parallel_for(0, len, 1 << 12, task);
+	else
+		task(0, len);
+}
+
+void maze::gen_parallel_wilsons()
+{
+	alloc(state::closed);
+
+	progress_reporter prog(progress, m_width * m_height * 2, m_pool);
+
+	if (m_width * m_height <= std::numeric_limits<std::uint32_t>::max())
+		parallel_wilsons<std::uint32_t>(prog);
+	else
+		parallel_wilsons<std::uint64_t>(prog);
 
-	find_exits(finished);
+	find_exits(prog);
 }
 
-bool get_orientation_is_horiz(std::mt19937 &gen, maze::len_t width, maze::len_t height)
+// small generator for the few numbers one rectangle of recursive division needs
+// seeded from the maze seed and the rectangle, so every rectangle has its own stream no matter which thread divides it
+struct rect_random
+{
+	using result_type = std::uint64_t;
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	rect_random(std::uint64_t seed, pt p, maze::len_t width, maze::len_t height) :
+		state{splitmix(splitmix(splitmix(splitmix(seed + 0x9e3779b97f4a7c15) ^ p.x) ^ p.y) ^ width) ^ height}
+	{
+	}
+
+	inline result_type operator()() { return splitmix(state += 0x9e3779b97f4a7c15); }
+
+	std::uint64_t state;
+};
+
+template <typename Gen>
+bool get_orientation_is_horiz(Gen &gen, maze::len_t width, maze::len_t height)
 {
 	if (width < height)
 		return true;
@@ -386,164 +1173,473 @@ bool get_orientation_is_horiz(std::mt19937 &gen, maze::len_t width, maze::len_t
 	return std::uniform_int_distribution<int>(0, 1)(gen);
 }
 
-void maze::divide(std::mt19937 &gen, pt p, maze::len_t width, maze::len_t height, bool horizontal_not_vertical, maze::len_t &count)
+// rectangles at least this big are divided by another task
+constexpr maze::len_t division_task_cells = 1 << 16;
+
+void maze::divide(rect r, std::vector<rect> &big, progress_reporter &prog)
 {
-	++count;
-	if (horizontal_not_vertical)
-	{
-		pt wall = p;
-		wall.y += std::uniform_int_distribution<maze::len_t>(0, height - 2)(gen);
-		len_t passage_x = wall.x + std::uniform_int_distribution<maze::len_t>(0, width - 1)(gen);
+	std::vector<rect> stack{r};
+	// cells in rectangles that can't be divided any more
+	len_t finished = 0;
 
-		pt i = wall;
-		for (; i.x < passage_x; ++i.x)
-			set_wall<state::closed>(i, direction::up);
-		len_t end = wall.x + width;
-		for (++i.x; i.x < end; ++i.x)
-			set_wall<state::closed>(i, direction::up);
+	auto push = [&](rect r) {
+		if (r.width < 2 || r.height < 2)
+			finished += r.width * r.height;
+		else if (r.width * r.height >= division_task_cells)
+			big.push_back(r);
+		else
+			stack.push_back(r);
+	};
 
-		len_t next_height = wall.y - p.y + 1;
-		if (next_height >= 2)
-			divide(gen, p, width, next_height, get_orientation_is_horiz(gen, width, next_height), count);
+	while (!stack.empty())
+	{
+		auto [p, width, height] = stack.back();
+		stack.pop_back();
 
-		next_height = p.y + height - wall.y - 1;
-		p.y = wall.y + 1;
-		if (next_height >= 2)
-			divide(gen, p, width, next_height, get_orientation_is_horiz(gen, width, next_height), count);
+		rect_random gen(get_seed(), p, width, height);
+
+		if (get_orientation_is_horiz(gen, width, height))
+		{
+			pt wall = p;
+			wall.y += std::uniform_int_distribution<maze::len_t>(0, height - 2)(gen);
+			len_t passage_x = wall.x + std::uniform_int_distribution<maze::len_t>(0, width - 1)(gen);
+
+			pt i = wall;
+			for (; i.x < passage_x; ++i.x)
+				set_wall_shared<state::closed>(i, direction::up);
+			len_t end = wall.x + width;
+			for (++i.x; i.x < end; ++i.x)
+				set_wall_shared<state::closed>(i, direction::up);
+
+			push({p, width, wall.y - p.y + 1});
+			push({{p.x, wall.y + 1}, width, p.y + height - wall.y - 1});
+		}
+		else
+		{
+			pt wall = p;
+			wall.x += std::uniform_int_distribution<maze::len_t>(0, width - 2)(gen);
+			len_t passage_y = wall.y + std::uniform_int_distribution<maze::len_t>(0, height - 1)(gen);
+
+			pt i = wall;
+			for (; i.y < passage_y; ++i.y)
+				set_wall_shared<state::closed>(i, direction::right);
+			len_t end = wall.y + height;
+			for (++i.y; i.y < end; ++i.y)
+				set_wall_shared<state::closed>(i, direction::right);
+
+			push({p, wall.x - p.x + 1, height});
+			push({{wall.x + 1, p.y}, p.x + width - wall.x - 1, height});
+		}
 	}
+
+	prog.add(finished);
+}
+
+void maze::gen_recursive_division()
+{
+	alloc(state::open);
+
+	get_seed();
+
+	progress_reporter prog(progress, m_width * m_height * 2, m_pool);
+
+	// big rectangles are divided in rounds, every one in its own task, until all that's left is small enough for one task to finish
+	// rectangles are kept in the order they were made so the seed makes the same maze for any number of threads
+	std::vector<rect> big;
+	if (m_width >= 2 && m_height >= 2)
+		big.push_back({{0, 0}, m_width, m_height});
 	else
+		prog.add(m_width * m_height);
+
+	while (!big.empty())
 	{
-		pt wall = p;
-		wall.x += std::uniform_int_distribution<maze::len_t>(0, width - 2)(gen);
-		len_t passage_y = wall.y + std::uniform_int_distribution<maze::len_t>(0, height - 1)(gen);
+		std::vector<std::vector<rect>> next(big.size());
+		auto task = [&](std::uint64_t first, std::uint64_t last) {
+			for (std::uint64_t i = first; i < last; ++i)
+				divide(big[i], next[i], prog);
+		};
+
+		if (m_pool)
+			m_pool->parallel_for(0, big.size(), 1, task);
+		else
+			task(0, big.size());
 
-		pt i = wall;
-		for (; i.y < passage_y; ++i.y)
-			set_wall<state::closed>(i, direction::right);
-		len_t end = wall.y + height;
-		for (++i.y; i.y < end; ++i.y)
-			set_wall<state::closed>(i, direction::right);
+		big.clear();
+		for (auto &n : next)
+			big.insert(big.end(), n.begin(), n.end());
+	}
 
-		len_t next_width = wall.x - p.x + 1;
-		if (next_width >= 2)
-			divide(gen, p, next_width, height, get_orientation_is_horiz(gen, next_width, height), count);
-		
-		next_width = p.x + width - wall.x - 1;
-		p.x = wall.x + 1;
-		if (next_width >= 2)
-			divide(gen, p, next_width, height, get_orientation_is_horiz(gen, next_width, height), count);
+	find_exits(prog);
+}
+
+// union find node of a cell, kept together so the union find touches one cache line per cell
+template <typename index_t>
+struct uf_node
+{
+	// a root is its own parent
+	index_t parent;
+	// earliest edge of the round that wants to link this root
+	std::uint32_t reserved;
+	std::uint8_t rank;
+};
+
+// finds halve the path as they go, and can run alongside each other
+template <typename index_t>
+index_t find_root(uf_node<index_t> *nodes, index_t x)
+{
+	for (;;)
+	{
+		index_t p = std::atomic_ref<index_t>(nodes[x].parent).load(std::memory_order_relaxed);
+		if (p == x)
+			return x;
+		index_t gp = std::atomic_ref<index_t>(nodes[p].parent).load(std::memory_order_relaxed);
+		if (gp == p)
+			return p;
+		std::atomic_ref<index_t>(nodes[x].parent).store(gp, std::memory_order_relaxed);
+		x = gp;
 	}
 }
 
-void maze::gen_recursive_division()
+constexpr std::uint32_t no_reservation = std::numeric_limits<std::uint32_t>::max();
+
+// the earliest edge of a round to reserve a root gets it
+inline void reserve(std::uint32_t &reservation, std::uint32_t i)
 {
-	alloc(state::open);
+	std::atomic_ref<std::uint32_t> r(reservation);
+	std::uint32_t cur = r.load(std::memory_order_relaxed);
+	while (i < cur && !r.compare_exchange_weak(cur, i, std::memory_order_relaxed));
+}
 
-	std::mt19937 gen(get_seed());
+template <typename index_t>
+void maze::kruskals(progress_reporter &prog)
+{
+	auto parallel_for = [this](len_t begin, len_t end, len_t grain, const std::function<void(std::uint64_t, std::uint64_t)> &fun) {
+		if (m_pool)
+			m_pool->parallel_for(begin, end, grain, fun);
+		else
+			fun(begin, end);
+	};
 
-	auto len = m_width * m_height;
+	len_t cells = m_width * m_height;
+	auto seed = static_cast<std::uint32_t>(get_seed());
 
-	len_t finished = 0;
-	// idk why it's this, but I plotted a big graph in excel and this was a good estimate
-	len_t divide_part_total = static_cast<len_t>(std::ceil(.4203 * len + 26.601));
+	// an edge is a cell's index times 2, plus 1 if it's the wall to the right of the cell instead of above it
+	len_t edge_count = 2 * cells - m_width - m_height;
+	mapped_vector<index_t, mapped::access::sequential> edges(edge_count);
+
+	// edges are shuffled by dealing them into random buckets and shuffling each bucket, which is as random as shuffling them all at once
+	// the edges are dealt in a fixed number of chunks, so the order is the same for every number of threads
+	{
+		constexpr len_t chunk_count = 64;
+		// buckets small enough to shuffle in cache
+		len_t bucket_count = std::max<len_t>(1, edge_count >> 16);
+		len_t ids = 2 * cells;
+
+		auto deal = [&](len_t c, auto &&put) {
+			std::seed_seq seq{seed, 0u, static_cast<std::uint32_t>(c)};
+			std::mt19937 gen(seq);
+
+			len_t first = ids * c / chunk_count;
+			len_t last = ids * (c + 1) / chunk_count;
+			len_t x = first / 2 % m_width;
+			len_t y = first / 2 / m_width;
+			for (len_t id = first; id < last; ++id)
+			{
+				bool right = id & 1;
+				if (right ? x + 1 < m_width : y + 1 < m_height)
+					put((static_cast<std::uint64_t>(gen()) * bucket_count) >> 32, id);
+				if (right && ++x == m_width)
+				{
+					x = 0;
+					++y;
+				}
+			}
+		};
+
+		// where every chunk's edges go in every bucket
+		std::vector<len_t> offsets(chunk_count * bucket_count);
+		parallel_for(0, chunk_count, 1, [&](len_t first, len_t last) {
+			for (len_t c = first; c < last; ++c)
+				deal(c, [&](len_t bucket, len_t) { ++offsets[c * bucket_count + bucket]; });
+		});
+
+		std::vector<len_t> bucket_first(bucket_count + 1);
+		len_t total = 0;
+		for (len_t b = 0; b < bucket_count; ++b)
+		{
+			bucket_first[b] = total;
+			for (len_t c = 0; c < chunk_count; ++c)
+			{
+				len_t count = offsets[c * bucket_count + b];
+				offsets[c * bucket_count + b] = total;
+				total += count;
+			}
+		}
+		bucket_first[bucket_count] = total;
 
-	std::jthread progress_task;
-	if (progress)
-		progress_task = std::jthread(progress_thread, progress, std::ref(finished), divide_part_total + len);
+		parallel_for(0, chunk_count, 1, [&](len_t first, len_t last) {
+			for (len_t c = first; c < last; ++c)
+				deal(c, [&](len_t bucket, len_t id) { edges[offsets[c * bucket_count + bucket]++] = static_cast<index_t>(id); });
+		});
 
-	if (m_width >= 2 && m_height >= 2)
-		divide(gen, {0, 0}, m_width, m_height, get_orientation_is_horiz(gen, m_width, m_height), finished);
+		parallel_for(0, bucket_count, 1, [&](len_t first, len_t last) {
+			for (len_t b = first; b < last; ++b)
+			{
+				std::seed_seq seq{seed, 1u, static_cast<std::uint32_t>(b), static_cast<std::uint32_t>(b >> 32)};
+				std::mt19937 gen(seq);
+				std::shuffle(edges.begin() + bucket_first[b], edges.begin() + bucket_first[b + 1], gen);
+			}
+		});
+	}
 
-	finished = divide_part_total;
-	find_exits(finished);
+	mapped_vector<uf_node<index_t>, mapped::access::random> nodes(cells);
+	parallel_for(0, cells, 1 << 16, [&](len_t first, len_t last) {
+		for (len_t i = first; i < last; ++i)
+			nodes[i] = {static_cast<index_t>(i), no_reservation, 0};
+	});
+
+	// edges are added in rounds with deterministic reservations, which gives the same maze as adding them one at a time in order
+	// every edge reserves the roots at both its ends, and the earliest edge of the round to touch a root gets it
+	// an edge that got either root links that root under the other, the edges before it didn't touch that root so they can't have joined the two trees
+	constexpr len_t round_size = 1 << 16;
+	constexpr len_t grain = 1 << 10;
+
+	std::vector<index_t> round;
+	round.reserve(round_size);
+	// roots of the ends of every edge in the round
+	std::vector<index_t> roots(round_size * 2);
+	std::vector<std::uint8_t> done(round_size);
+
+	len_t next = 0;
+	while (next < edge_count || !round.empty())
+	{
+		// edges that didn't get a root last time go first, in the same order
+		while (round.size() < round_size && next < edge_count)
+			round.push_back(edges[next++]);
+
+		parallel_for(0, round.size(), grain, [&](len_t first, len_t last) {
+			for (len_t i = first; i < last; ++i)
+			{
+				index_t a = round[i] >> 1;
+				index_t b = round[i] & 1 ? a + 1 : static_cast<index_t>(a + m_width);
+				index_t u = find_root(nodes.data(), a);
+				index_t v = find_root(nodes.data(), b);
+
+				// would make a loop
+				if (u == v)
+				{
+					done[i] = true;
+					continue;
+				}
+
+				done[i] = false;
+				roots[2 * i] = u;
+				roots[2 * i + 1] = v;
+				reserve(nodes[u].reserved, static_cast<std::uint32_t>(i));
+				reserve(nodes[v].reserved, static_cast<std::uint32_t>(i));
+			}
+		});
+
+		parallel_for(0, round.size(), grain, [&](len_t first, len_t last) {
+			len_t added = 0;
+			for (len_t i = first; i < last; ++i)
+			{
+				if (done[i])
+					continue;
+
+				index_t u = roots[2 * i];
+				index_t v = roots[2 * i + 1];
+				auto held = [&](index_t r) { return std::atomic_ref<std::uint32_t>(nodes[r].reserved).load(std::memory_order_relaxed) == i; };
+				bool hold_u = held(u);
+				bool hold_v = held(v);
+
+				if (!hold_u && !hold_v)
+					continue;
+
+				if (hold_u && hold_v)
+				{
+					// nothing else touches either root, so union by rank is safe
+					if (nodes[u].rank < nodes[v].rank)
+						std::swap(u, v);
+					else if (nodes[u].rank == nodes[v].rank)
+						++nodes[u].rank;
+					// u stays a root
+					std::atomic_ref<std::uint32_t>(nodes[u].reserved).store(no_reservation, std::memory_order_relaxed);
+				}
+				else if (hold_u)
+					std::swap(u, v);
+
+				// v is never a root again, so its reservation doesn't have to be cleared
+				nodes[v].parent = u;
+
+				len_t a = round[i] >> 1;
+				set_wall_shared<state::open>({a % m_width, a / m_width}, round[i] & 1 ? direction::right : direction::up);
+
+				done[i] = true;
+				++added;
+			}
+			prog.add(added);
+		});
+
+		len_t kept = 0;
+		for (len_t i = 0; i < round.size(); ++i)
+			if (!done[i])
+				round[kept++] = round[i];
+		round.resize(kept);
+	}
 }
 
-// struct edge
-// {
-//     edge(maze::len_t x, maze::len_t y, maze::direction _dir) : p{x, y}, dir{_dir} {}
-//     pt p;
-//     maze::direction dir;
-// };
+void maze::gen_kruskals()
+{
+	alloc(state::closed);
 
-// struct tree
-// {
-//     tree() : parent{} {}
+	progress_reporter prog(progress, m_width * m_height * 2, m_pool);
+	// a spanning tree has one edge fewer than cells
+	prog.add(1);
 
-//     tree *root()
-//     {
-//         if (parent)
-//             return parent->root();
-//         else
-//             return this;
-//     }
+	// half the memory when edge indices fit
+	if (2 * m_width * m_height <= std::numeric_limits<std::uint32_t>::max())
+		kruskals<std::uint32_t>(prog);
+	else
+		kruskals<std::uint64_t>(prog);
 
-//     tree *parent;
-// };
+	find_exits(prog);
+}
 
-// using tree
-// void maze::gen_kruskals()
-// {
-//     alloc();
+template <maze::state s>
+void maze::set_wall_shared(pt p, direction dir)
+{
+	if (dir == direction::down)
+	{
+		if (--p.y == static_cast<maze::len_t>(-1))
+			return;
+		dir = direction::up;
+	}
+	else if (dir == direction::left)
+	{
+		if (--p.x == static_cast<maze::len_t>(-1))
+			return;
+		dir = direction::right;
+	}
 
-//     len_t num_edges = (m_width * 2 - 1) * m_height - m_width;
-//     len_t num_cells = m_width * m_height;
+	len_t i = cell_index(p);
+	std::uint32_t bit = std::uint32_t{1} << (static_cast<unsigned int>(i % 16) * 2 + (dir == direction::right));
+	std::atomic_ref<std::uint32_t> word(m_data[i / 16]);
+	if constexpr (s == state::closed)
+		word.fetch_and(~bit, std::memory_order_relaxed);
+	else
+		word.fetch_or(bit, std::memory_order_relaxed);
+}
 
-//     len_t cur_top = 0;
-//     std::thread progress_task;
-//     if (progress)
-//         progress_task = std::thread(progress_thread, progress, std::ref(cur_top), num_edges + m_width * m_height);
+void maze::gen_ellers()
+{
+	alloc(state::closed);
 
-//     std::vector<tree> sets(num_cells);
-//     std::vector<edge> edges;
+	progress_reporter prog(progress, m_width * m_height * 2, m_pool);
 
-//     edges.reserve(num_edges);
+	{
+		ellers gen(m_width, m_height, get_seed());
+		len_t words = (m_width + 63) / 64;
+		std::vector<std::uint64_t> up(words), right(words);
 
-//     // first row
-//     for (len_t x = 0; x < m_width - 1; ++x)
-//         edges.emplace_back(x, 0, direction::right);
+		for (len_t y = 0; y < m_height; ++y)
+		{
+			gen.next(up.data(), right.data());
+			for (len_t w = 0; w < words; ++w)
+			{
+				for (std::uint64_t b = up[w]; b; b &= b - 1)
+					set_wall<state::open>({w * 64 + std::countr_zero(b), y}, direction::up);
+				for (std::uint64_t b = right[w]; b; b &= b - 1)
+					set_wall<state::open>({w * 64 + std::countr_zero(b), y}, direction::right);
+			}
+			prog.add(m_width);
+		}
+	}
 
-//     for (len_t y = 1; y < m_height; ++y)
-//     {
-//         for (len_t x = 0; x < m_width - 1; ++x)
-//         {
-//             edges.emplace_back(x, y, direction::right);
-//             edges.emplace_back(x, y, direction::down);
-//         }
-//     }
+	find_exits(prog);
+}
 
-//     std::mt19937 gen(get_seed());
+void maze::gen_ellers(const row_consumer &consumer)
+{
+	m_data.clear();
+	unload();
 
-//     std::shuffle(edges.begin(), edges.end(), gen);
+	progress_reporter prog(progress, m_height, m_pool);
 
-//     for (auto e : edges)
-//     {
-//         pt moved = e.p;
-//         move(moved, e.dir);
+	ellers gen(m_width, m_height, get_seed());
+	len_t words = (m_width + 63) / 64;
+	std::vector<std::uint64_t> up(words), right(words);
 
-//         tree *a = sets.data() + e.p.y * m_width + e.p.x;
-//         tree *b = sets.data() + moved.y * m_width + moved.x;
+	for (len_t y = 0; y < m_height; ++y)
+	{
+		gen.next(up.data(), right.data());
+		consumer(y, up.data(), right.data());
+		prog.add(1);
+	}
 
-//         tree *a_root = a->root();
-//         tree *b_root = b->root();
+	m_entrance = {0, 0};
+	m_exit = {m_width - 1, m_height - 1};
+	m_solution_distance = m_solution_branch_count = 0;
+	m_difficulty = 0;
+}
 
-//         ++cur_top;
+// packs the even bits of x into the low 16 bits
+constexpr std::uint32_t even_bits(std::uint32_t x)
+{
+	x &= 0x55555555;
+	x = (x | (x >> 1)) & 0x33333333;
+	x = (x | (x >> 2)) & 0x0f0f0f0f;
+	x = (x | (x >> 4)) & 0x00ff00ff;
+	x = (x | (x >> 8)) & 0x0000ffff;
+	return x;
+}
 
-//         if (a_root == b_root)
-//             continue;
+// ors the low n bits of bits into out starting at bit pos
+inline void put_bits(std::uint64_t *out, maze::len_t pos, std::uint64_t bits, unsigned int n)
+{
+	out[pos / 64] |= bits << (pos % 64);
+	if (pos % 64 + n > 64)
+		out[pos / 64 + 1] |= bits >> (64 - pos % 64);
+}
 
-//         b_root->parent = a;
+void maze::get_row(len_t y, std::uint64_t *up, std::uint64_t *right) const
+{
+	if (!cell_words())
+		throw std::runtime_error("No maze generated");
+	if (y >= m_height)
+		throw std::out_of_range("Row not in range");
 
-//         set_wall(e.p.x, e.p.y, e.dir, state::open);
-//     }
+	len_t words = (m_width + 63) / 64;
+	std::fill(up, up + words, 0);
+	std::fill(right, right + words, 0);
 
-//     find_exits(cur_top);
+	const std::uint32_t *data = cells();
+	len_t data_words = cell_words();
 
-//     cur_top = m_width * m_height + num_edges;
+	// cells are read in runs that are contiguous in storage, a whole row or a tile's row
+	len_t run = m_tiles_per_row ? tile_size : m_width;
+	for (len_t x = 0; x < m_width; x += run)
+	{
+		len_t count = std::min(run, m_width - x);
+		len_t i = cell_index({x, y});
+		for (len_t c = 0; c < count; c += 16, i += 16)
+		{
+			len_t base_i = i / 16;
+			unsigned int bit_off = static_cast<unsigned int>(i % 16) * 2;
+
+			std::uint64_t bits = data[base_i] >> bit_off;
+			if (bit_off && base_i + 1 < data_words)
+				bits |= static_cast<std::uint64_t>(data[base_i + 1]) << (32 - bit_off);
 
-//     if (progress)
-//         progress_task.join();
-// }
+			unsigned int n = static_cast<unsigned int>(std::min<len_t>(16, count - c));
+			std::uint32_t mask = (std::uint32_t{1} << n) - 1;
+			auto cells = static_cast<std::uint32_t>(bits);
 
+			put_bits(up, x + c, even_bits(cells) & mask, n);
+			put_bits(right, x + c, even_bits(cells >> 1) & mask, n);
+		}
+	}
+}
 
 template <maze::state s>
 void maze::set_wall(pt p, direction dir)
@@ -561,7 +1657,7 @@ void maze::set_wall(pt p, direction dir)
 		dir = direction::right;
 	}
 
-	len_t i = p.y * m_width + p.x;
+	len_t i = cell_index(p);
 	len_t base_i = i / 16;
 	len_t cell_i = i % 16;
 	len_t bit_i = cell_i * 2;
@@ -590,7 +1686,7 @@ maze::state maze::get_wall(pt p, direction dir) const
 		dir = direction::right;
 	}
 
-	len_t i = p.y * m_width + p.x;
+	len_t i = cell_index(p);
 	len_t base_i = i / 16;
 	len_t cell_i = i % 16;
 	len_t bit_i = cell_i * 2;
@@ -598,7 +1694,127 @@ maze::state maze::get_wall(pt p, direction dir) const
 	if (dir == direction::right)
 		++bit_i;
 
-	if (m_data[base_i] & ((std::uint32_t)1 << bit_i))
+	if (cells()[base_i] & ((std::uint32_t)1 << bit_i))
 		return state::open;
 	return state::closed;
-}
\ No newline at end of file
+}
+
+namespace
+{
+	// start of a .mz file, the cells follow at header_size, exactly as they're stored in m_data
+	// everything is little endian, and files are only read and written on little endian machines so the cells can be mapped as they are
+	struct mz_header
+	{
+		char magic[4];
+		std::uint32_t version;
+		// multiple of 8, so the cells are aligned
+		std::uint32_t header_size;
+		std::uint32_t flags;
+		std::uint64_t width, height;
+		std::uint32_t seed;
+		std::uint32_t algorithm;
+		std::uint64_t entrance_x, entrance_y;
+		std::uint64_t exit_x, exit_y;
+		double difficulty;
+		std::uint64_t solution_branch_count;
+		std::uint64_t solution_distance;
+		// number of 32 bit words of cells
+		std::uint64_t cell_words;
+	};
+	static_assert(sizeof(mz_header) == 104, "mz_header has padding");
+
+	constexpr char mz_magic[4] = {'M', 'K', 'M', 'Z'};
+	constexpr std::uint32_t mz_version = 1;
+	// the cells are stored in tiles
+	constexpr std::uint32_t mz_tiled = 1;
+
+	void check_endian()
+	{
+		if constexpr (std::endian::native != std::endian::little)
+			throw std::runtime_error(".mz files can only be used on little endian machines");
+	}
+}
+
+void maze::save(const std::string &name, std::uint32_t algorithm) const
+{
+	check_endian();
+	if (!cell_words())
+		throw std::runtime_error("No maze generated");
+
+	mz_header h{};
+	std::memcpy(h.magic, mz_magic, sizeof(h.magic));
+	h.version = mz_version;
+	h.header_size = sizeof(h);
+	h.flags = m_tiles_per_row ? mz_tiled : 0;
+	h.width = m_width;
+	h.height = m_height;
+	h.seed = static_cast<std::uint32_t>(m_seed);
+	h.algorithm = algorithm;
+	h.entrance_x = m_entrance.x;
+	h.entrance_y = m_entrance.y;
+	h.exit_x = m_exit.x;
+	h.exit_y = m_exit.y;
+	h.difficulty = m_difficulty;
+	h.solution_branch_count = m_solution_branch_count;
+	h.solution_distance = m_solution_distance;
+	h.cell_words = cell_words();
+
+	std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(name.c_str(), "wb"), std::fclose);
+	if (!file)
+		throw std::runtime_error("Couldn't open " + name);
+
+	if (std::fwrite(&h, sizeof(h), 1, file.get()) != 1 ||
+		std::fwrite(cells(), sizeof(std::uint32_t), cell_words(), file.get()) != cell_words() ||
+		std::fflush(file.get()))
+		throw std::runtime_error("Couldn't write " + name);
+}
+
+std::uint32_t maze::load(const std::string &name)
+{
+	check_endian();
+
+	// whatever was stored is freed first, so its memory isn't held next to the mapping, and a file that turns out to be bad leaves no maze
+	mapped_vector<std::uint32_t>().swap(m_data);
+	unload();
+
+	auto file = std::make_shared<const mapped::file>(name);
+
+	mz_header h{};
+	if (file->size() < sizeof(h))
+		throw std::runtime_error(name + " isn't a .mz file");
+	std::memcpy(&h, file->data(), sizeof(h));
+
+	if (std::memcmp(h.magic, mz_magic, sizeof(h.magic)))
+		throw std::runtime_error(name + " isn't a .mz file");
+	if (h.version != mz_version)
+		throw std::runtime_error(name + " is a version " + std::to_string(h.version) + " .mz file, only version " + std::to_string(mz_version) + " can be read");
+	if (h.header_size < sizeof(h) || h.header_size % 8 || h.header_size > file->size())
+		throw std::runtime_error(name + " has a bad header");
+	// also keeps the cell count from overflowing
+	if (h.width < 1 || h.height < 1 || h.width > (len_t{1} << 32) || h.height > (len_t{1} << 31))
+		throw std::runtime_error(name + " has bad dimensions");
+
+	m_width = h.width;
+	m_height = h.height;
+	m_layout = h.flags & mz_tiled ? layout::tiled : layout::row_major;
+	set_tiles_per_row();
+
+	len_t words = (cell_count() + 15) / 16;
+	if (h.cell_words != words || (file->size() - h.header_size) / sizeof(std::uint32_t) < words)
+		throw std::runtime_error(name + " is cut short or has the wrong number of cells");
+	if (h.entrance_x >= m_width || h.entrance_y >= m_height || h.exit_x >= m_width || h.exit_y >= m_height)
+		throw std::runtime_error(name + " has an entrance or exit outside the maze");
+
+	set_seed(h.seed);
+	m_entrance = {h.entrance_x, h.entrance_y};
+	m_exit = {h.exit_x, h.exit_y};
+	m_difficulty = h.difficulty;
+	m_solution_branch_count = h.solution_branch_count;
+	m_solution_distance = h.solution_distance;
+
+	m_file_cells = reinterpret_cast<const std::uint32_t *>(file->data() + h.header_size);
+	m_file_words = words;
+	m_file = std::move(file);
+
+	return h.algorithm;
+}
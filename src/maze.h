@@ -2,7 +2,14 @@
 #include <vector>
 #include <stdexcept>
 #include <functional>
+#include <memory>
 #include <random>
+#include <string>
+
+#include "mapped.h"
+
+class thread_pool;
+class progress_reporter;
 
 struct pt
 {
@@ -25,13 +32,29 @@ public:
         none = -1
     };
 
+    // order cells are stored in
+    enum class layout : char
+    {
+        // row by row, cells above and below are a whole row away
+        row_major,
+        // in square tiles of tile_size x tile_size cells, so neighbours above and below are usually on the same cache line
+        // mazes narrower or shorter than a tile are stored row by row
+        tiled,
+    };
+
+    static constexpr unsigned int tile_shift = 6;
+    static constexpr std::uint64_t tile_size = 1 << tile_shift;
+
     inline maze() : 
         m_data{},
         m_width{}, m_height{},
         m_entrance{}, m_exit{},
         m_solution_branch_count{}, m_solution_distance{}, m_difficulty{},
         has_seed{},
-        progress{}
+        progress{},
+        m_pool{},
+        m_layout{layout::row_major}, m_tiles_per_row{},
+        m_file{}, m_file_cells{}, m_file_words{}
     {
     }
     inline maze(len_t width, len_t height) :
@@ -40,7 +63,10 @@ public:
         m_entrance{}, m_exit{},
         m_solution_branch_count{}, m_solution_distance{}, m_difficulty{},
         has_seed{},
-        progress{}
+        progress{},
+        m_pool{},
+        m_layout{layout::row_major}, m_tiles_per_row{},
+        m_file{}, m_file_cells{}, m_file_words{}
     {
     }
 
@@ -64,21 +90,34 @@ public:
     // fun is a function who takes a double between 0 and 1 representing progress
     inline void set_progress_callback(std::function<void(double)> fun) { progress = std::move(fun); }
 
+    // with a pool of more than one thread, big mazes are analysed in parallel once they're generated
+    inline void set_thread_pool(thread_pool *pool) { m_pool = pool; }
+
     inline bool is_wall_open(pt p, direction dir) const
     {
-        if (m_data.empty())
+        if (!cell_words())
             throw std::runtime_error("No maze generated");
         if (p.x > m_width || p.y > m_height)
             throw std::out_of_range("Cell not in range");
         return get_wall(p, dir) == state::open;
     }
 
+    /// @brief reads the walls of a whole row at once
+    /// @param y row to read
+    /// @param up receives one bit per cell, set if the wall above the cell is open, must hold (width + 63) / 64 words
+    /// @param right receives one bit per cell, set if the wall right of the cell is open, must hold (width + 63) / 64 words
+    void get_row(len_t y, std::uint64_t *up, std::uint64_t *right) const;
+
     inline void set_dims(len_t width, len_t height)
     {
         m_width = width;
         m_height = height;
     }
 
+    // takes effect the next time a maze is generated
+    inline void set_layout(layout l) { m_layout = l; }
+    inline layout get_layout() const { return m_layout; }
+
     inline void set_seed(std::uint_least32_t seed)
     {
         m_seed = seed;
@@ -91,8 +130,36 @@ public:
     std::uint_least32_t get_seed();
 
     void gen_recursive_backtracker();
+    // backtracks on tiles of 1024x1024 cells in parallel, and joins the tiles with one opening between each pair a backtracker over the tiles moves through
+    void gen_parallel_backtracker();
     void gen_wilsons();
+    // many walkers at once, makes the same maze for a seed whatever the number of threads, but not the same one as gen_wilsons
+    void gen_parallel_wilsons();
     void gen_recursive_division();
+    void gen_kruskals();
+    void gen_ellers();
+
+    // receives the rows of a maze as they're made, in the same format as get_row
+    using row_consumer = std::function<void(len_t y, const std::uint64_t *up, const std::uint64_t *right)>;
+
+    // makes a maze with eller's algorithm without storing it, handing each row to consumer from y = 0 up
+    // a maze that isn't stored can't be analysed, so the entrance is (0, 0) and the exit is the opposite corner
+    void gen_ellers(const row_consumer &consumer);
+
+    // analyses the stored maze again and picks its exit, every generator that stores a maze already does this
+    void find_exits();
+
+    /// @brief writes the stored maze and what analysing it found to a .mz file, which load can read back without generating it again
+    /// @param name name of the file, replaced if it's already there
+    /// @param algorithm tag of the algorithm that made the maze, stored as is
+    /// throws std::runtime_error if no maze is stored or the file can't be written
+    void save(const std::string &name, std::uint32_t algorithm) const;
+
+    /// @brief replaces the maze with one written by save, the cells are mapped from the file and only read as they're used
+    /// @param name name of the file
+    /// @return the algorithm tag passed to save
+    /// throws std::runtime_error if the file can't be read or isn't a .mz file, in which case no maze is left stored
+    std::uint32_t load(const std::string &name);
 
 private:
     enum class state : bool
@@ -102,7 +169,7 @@ private:
     };
 
     // bit set to 1 is open, 0 is closed
-    std::vector<std::uint32_t> m_data;
+    mapped_vector<std::uint32_t> m_data;
     len_t m_width;
     len_t m_height;
 
@@ -118,21 +185,102 @@ private:
 
     std::function<void(double)> progress;
 
-    void find_exits(len_t &count);
-    // returns true if p branches into more than or equal to n cells by first moving dir
-    template <len_t n>
-    bool explore_n(pt p, direction dir) const;
-    len_t get_num_available(pt p, maze::direction prev_opp) const;
+    thread_pool *m_pool;
+
+    layout m_layout;
+    // 0 if cells are stored row by row
+    len_t m_tiles_per_row;
+
+    // set while the cells come from a file load mapped, m_data is empty then
+    std::shared_ptr<const mapped::file> m_file;
+    const std::uint32_t *m_file_cells;
+    len_t m_file_words;
+
+    // every read of the cells goes through these, writes always go to m_data
+    inline const std::uint32_t *cells() const { return m_file_cells ? m_file_cells : m_data.data(); }
+    inline len_t cell_words() const { return m_file_cells ? m_file_words : m_data.size(); }
+    // drops the cells of a loaded maze
+    inline void unload()
+    {
+        m_file.reset();
+        m_file_cells = nullptr;
+        m_file_words = 0;
+    }
+
+    inline void set_tiles_per_row()
+    {
+        if (m_layout == layout::tiled && m_width >= tile_size && m_height >= tile_size)
+            m_tiles_per_row = (m_width + tile_size - 1) >> tile_shift;
+        else
+            m_tiles_per_row = 0;
+    }
+
+    // index of a cell in storage
+    inline len_t cell_index(pt p) const
+    {
+        if (!m_tiles_per_row)
+            return p.y * m_width + p.x;
+
+        static constexpr len_t tile_mask = tile_size - 1;
+        len_t tile = (p.y >> tile_shift) * m_tiles_per_row + (p.x >> tile_shift);
+        return (tile << (2 * tile_shift)) | ((p.y & tile_mask) << tile_shift) | (p.x & tile_mask);
+    }
+
+    // number of cells in storage, including the padding of partial tiles
+    inline len_t cell_count() const
+    {
+        if (!m_tiles_per_row)
+            return m_width * m_height;
+        return m_tiles_per_row * ((m_height + tile_size - 1) >> tile_shift) * tile_size * tile_size;
+    }
+
+    // cells on the edge of the maze, with how far and how hard they are to reach from the entrance
+    struct perimeter;
+
+    // finds the exit furthest from the entrance, counting one for every cell
+    void find_exits(progress_reporter &prog);
+    void analyse(progress_reporter &prog, perimeter &entrance) const;
+    // false if dir leads out of the maze
+    bool passage(pt p, direction dir) const;
+    // number of cells the branch behind p's wall in dir goes deeper than the cell it starts with, up to cap
+    len_t branch_depth(pt p, direction dir, len_t cap) const;
+    // analyses strips of strip_rows rows in parallel
+    void analyse_strips(progress_reporter &prog, perimeter &entrance, len_t strip_rows) const;
 
     template <state s>
     void set_wall(pt p, direction dir);
     state get_wall(pt p, direction dir) const;
+    // same as set_wall, but safe while other threads set walls
+    template <state s>
+    void set_wall_shared(pt p, direction dir);
 
     inline void alloc(state s)
     {
+        set_tiles_per_row();
+        unload();
+
         m_data.clear();
-        m_data.resize((m_width * m_height + 15) / 16, s == state::closed ? 0 : std::numeric_limits<std::uint32_t>::max());
+        m_data.resize((cell_count() + 15) / 16, s == state::closed ? 0 : std::numeric_limits<std::uint32_t>::max());
     }
 
-    void divide(std::mt19937 &gen, pt p, maze::len_t width, maze::len_t height, bool horizontal_not_vertical, len_t &count);
+    template <typename index_t>
+    void wilsons(progress_reporter &prog);
+    template <typename index_t>
+    void parallel_wilsons(progress_reporter &prog);
+    template <typename index_t>
+    void kruskals(progress_reporter &prog);
+
+    // rectangular part of the maze
+    struct rect
+    {
+        pt p;
+        len_t width, height;
+    };
+
+    // divides r with an explicit stack, and leaves the pieces that are big enough for a task of their own in big
+    // adds the cells of the pieces that can't be divided any more to prog
+    void divide(rect r, std::vector<rect> &big, progress_reporter &prog);
+
+    // fills r with a maze of its own, adds r's cells to prog
+    void backtrack(rect r, std::mt19937 &gen, progress_reporter &prog);
 };
\ No newline at end of file
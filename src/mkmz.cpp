@@ -0,0 +1,305 @@
+#include "mkmz.h"
+#include "maze.h"
+#include "image.h"
+#include "render.h"
+#include "algorithm.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+struct mkmz_maze
+{
+	maze m;
+	// null while the maze uses one thread
+	std::unique_ptr<thread_pool> pool;
+
+	bool generated;
+	algorithm_type algorithm;
+	uint_least32_t seed;
+};
+
+namespace
+{
+	thread_local std::string last_error;
+
+	mkmz_status fail(mkmz_status status, const char *what)
+	{
+		last_error = what;
+		return status;
+	}
+
+	// runs fun, turning whatever it throws into a status
+	template <typename fun_t>
+	mkmz_status guard(fun_t fun)
+	{
+		try
+		{
+			fun();
+			return MKMZ_OK;
+		}
+		catch (const std::bad_alloc &)
+		{
+			return fail(MKMZ_OUT_OF_MEMORY, "Out of memory");
+		}
+		catch (const std::logic_error &e)
+		{
+			// out_of_range, length_error and invalid_argument
+			return fail(MKMZ_INVALID_ARGUMENT, e.what());
+		}
+		catch (const std::exception &e)
+		{
+			return fail(MKMZ_FAILED, e.what());
+		}
+	}
+
+	mkmz_status check(const mkmz_maze *maze)
+	{
+		if (!maze)
+			return fail(MKMZ_INVALID_ARGUMENT, "Maze is null");
+		if (!maze->generated)
+			return fail(MKMZ_NOT_GENERATED, "Maze hasn't been generated");
+		return MKMZ_OK;
+	}
+
+	// format of the image style draws maze with, throws if it's too big
+	mkmz_image_format format_of(const mkmz_maze &maze, const mkmz_style &style)
+	{
+		mkmz_image_format res{};
+		res.width = (style.cell_width + style.wall_width) * maze.m.width() + style.wall_width;
+		res.height = (style.cell_height + style.wall_width) * maze.m.height() + style.wall_width;
+		if (!image::within_limits(res.width, res.height))
+			throw std::length_error("Image width and or height are too large");
+
+		uint16_t wall_color[4], cell_color[4];
+		std::copy(style.wall_color, style.wall_color + 4, wall_color);
+		std::copy(style.cell_color, style.cell_color + 4, cell_color);
+
+		color_t col;
+		pick_format(wall_color, cell_color, res.depth, col);
+		res.color_type = static_cast<mkmz_color_type>(col);
+		res.row_bytes = image::row_len(res.width, res.depth, col) * sizeof(image::base_t);
+		return res;
+	}
+
+	// renders every row of the image style draws maze with, row(y) gives the buffer for row y
+	template <typename row_fun_t>
+	void render(const mkmz_maze &maze, const mkmz_style &style, const mkmz_image_format &format, row_fun_t row)
+	{
+		uint16_t wall_color[4], cell_color[4];
+		std::copy(style.wall_color, style.wall_color + 4, wall_color);
+		std::copy(style.cell_color, style.cell_color + 4, cell_color);
+
+		maze_renderer renderer(maze.m, style.cell_width, style.cell_height, style.wall_width, wall_color, cell_color, format.depth, static_cast<color_t>(format.color_type));
+
+		// same strips as render_image
+		auto strip = [&](uint64_t first, uint64_t last) { render_rows(renderer, first, last, row); };
+		if (maze.pool)
+			maze.pool->parallel_for(0, format.height, 64, strip);
+		else
+			strip(0, format.height);
+	}
+}
+
+int mkmz_abi_version(void)
+{
+	return MKMZ_ABI_VERSION;
+}
+
+const char *mkmz_last_error(void)
+{
+	return last_error.c_str();
+}
+
+mkmz_status mkmz_maze_create(uint64_t width, uint64_t height, mkmz_maze **maze)
+{
+	if (!maze)
+		return fail(MKMZ_INVALID_ARGUMENT, "Maze is null");
+	if (width < 2 || height < 2)
+		return fail(MKMZ_INVALID_ARGUMENT, "Maze width/height must be greater than 1");
+
+	return guard([&] {
+		*maze = new mkmz_maze{::maze(width, height), nullptr, false, algorithm_type::recursive_backtracker, 0};
+	});
+}
+
+void mkmz_maze_destroy(mkmz_maze *maze)
+{
+	delete maze;
+}
+
+mkmz_status mkmz_maze_set_threads(mkmz_maze *maze, unsigned int threads)
+{
+	if (!maze)
+		return fail(MKMZ_INVALID_ARGUMENT, "Maze is null");
+	if (!threads)
+		return fail(MKMZ_INVALID_ARGUMENT, "Thread count must be at least 1");
+
+	return guard([&] {
+		maze->m.set_thread_pool(nullptr);
+		maze->pool.reset();
+		if (threads > 1)
+		{
+			maze->pool = std::make_unique<thread_pool>(threads);
+			maze->m.set_thread_pool(maze->pool.get());
+		}
+	});
+}
+
+mkmz_status mkmz_maze_set_tiled(mkmz_maze *maze, int tiled)
+{
+	if (!maze)
+		return fail(MKMZ_INVALID_ARGUMENT, "Maze is null");
+	maze->m.set_layout(tiled ? ::maze::layout::tiled : ::maze::layout::row_major);
+	return MKMZ_OK;
+}
+
+mkmz_status mkmz_maze_generate(mkmz_maze *maze, mkmz_algorithm algorithm, const uint32_t *seed)
+{
+	if (!maze)
+		return fail(MKMZ_INVALID_ARGUMENT, "Maze is null");
+	if (algorithm < MKMZ_RECURSIVE_BACKTRACKER || algorithm > MKMZ_ELLERS)
+		return fail(MKMZ_INVALID_ARGUMENT, "Unknown algorithm");
+
+	return guard([&] {
+		// a maze that fails half way isn't left looking generated
+		maze->generated = false;
+		if (seed)
+			maze->m.set_seed(*seed);
+		else
+			maze->m.set_seed();
+
+		maze->algorithm = static_cast<algorithm_type>(algorithm);
+		generate(maze->m, maze->algorithm);
+
+		maze->seed = maze->m.get_seed();
+		maze->generated = true;
+	});
+}
+
+uint64_t mkmz_maze_width(const mkmz_maze *maze)
+{
+	return maze ? maze->m.width() : 0;
+}
+
+uint64_t mkmz_maze_height(const mkmz_maze *maze)
+{
+	return maze ? maze->m.height() : 0;
+}
+
+mkmz_status mkmz_maze_is_open(const mkmz_maze *maze, uint64_t x, uint64_t y, mkmz_direction dir, int *open)
+{
+	if (mkmz_status status = check(maze))
+		return status;
+	if (!open || x >= maze->m.width() || y >= maze->m.height() || dir < MKMZ_UP || dir > MKMZ_LEFT)
+		return fail(MKMZ_INVALID_ARGUMENT, "Cell not in range, bad direction, or open is null");
+
+	return guard([&] { *open = maze->m.is_wall_open({x, y}, static_cast<::maze::direction>(dir)); });
+}
+
+mkmz_status mkmz_maze_get_row(const mkmz_maze *maze, uint64_t y, uint64_t *up, uint64_t *right)
+{
+	if (mkmz_status status = check(maze))
+		return status;
+	if (!up || !right)
+		return fail(MKMZ_INVALID_ARGUMENT, "Row buffers are null");
+
+	return guard([&] { maze->m.get_row(y, up, right); });
+}
+
+mkmz_status mkmz_maze_analysis(const mkmz_maze *maze, mkmz_analysis *analysis)
+{
+	if (mkmz_status status = check(maze))
+		return status;
+	if (!analysis)
+		return fail(MKMZ_INVALID_ARGUMENT, "Analysis is null");
+
+	const ::maze &m = maze->m;
+	analysis->seed = maze->seed;
+	analysis->entrance_x = m.entrance().x;
+	analysis->entrance_y = m.entrance().y;
+	analysis->exit_x = m.exit().x;
+	analysis->exit_y = m.exit().y;
+	analysis->difficulty = m.difficulty();
+	analysis->solution_branch_count = m.solution_branch_count();
+	analysis->solution_distance = m.solution_distance();
+	return MKMZ_OK;
+}
+
+void mkmz_style_default(mkmz_style *style)
+{
+	if (!style)
+		return;
+	*style = mkmz_style{1, 1, 1, {0, 0, 0, 255}, {255, 255, 255, 255}};
+}
+
+mkmz_status mkmz_image_format_of(const mkmz_maze *maze, const mkmz_style *style, mkmz_image_format *format)
+{
+	if (!maze || !style || !format)
+		return fail(MKMZ_INVALID_ARGUMENT, "Maze, style or format is null");
+
+	return guard([&] { *format = format_of(*maze, *style); });
+}
+
+mkmz_status mkmz_render(const mkmz_maze *maze, const mkmz_style *style, void *pixels, uint64_t stride)
+{
+	if (mkmz_status status = check(maze))
+		return status;
+	if (!style || !pixels)
+		return fail(MKMZ_INVALID_ARGUMENT, "Style or pixels is null");
+	if (reinterpret_cast<std::uintptr_t>(pixels) % sizeof(image::base_t) || stride % sizeof(image::base_t))
+		return fail(MKMZ_INVALID_ARGUMENT, "Pixels and stride must be multiples of 8 bytes");
+
+	return guard([&] {
+		mkmz_image_format format = format_of(*maze, *style);
+		if (stride < format.row_bytes)
+			throw std::invalid_argument("Stride is smaller than a row");
+
+		auto rows = static_cast<image::base_t *>(pixels);
+		render(*maze, *style, format, [rows, stride](uint64_t y) { return rows + y * (stride / sizeof(image::base_t)); });
+
+		// the renderer packs 1 bit pixels starting at the lowest bit, the caller gets them the way a png has them
+		if (format.depth < 8)
+			for (uint64_t y = 0; y < format.height; ++y)
+				image::reverse_bits(static_cast<unsigned char *>(pixels) + y * stride, format.row_bytes);
+	});
+}
+
+mkmz_status mkmz_encode_png(const mkmz_maze *maze, const mkmz_style *style, int compression_level, void **png, size_t *size)
+{
+	if (mkmz_status status = check(maze))
+		return status;
+	if (!style || !png || !size)
+		return fail(MKMZ_INVALID_ARGUMENT, "Style, png or size is null");
+	if (compression_level < 0 || compression_level > 9)
+		return fail(MKMZ_INVALID_ARGUMENT, "Compression level ranges from 0 to 9");
+
+	return guard([&] {
+		mkmz_image_format format = format_of(*maze, *style);
+		image img(format.width, format.height, format.depth, static_cast<color_t>(format.color_type));
+		render(*maze, *style, format, [&img](uint64_t y) { return img.row(y); });
+
+		const ::maze &m = maze->m;
+		auto chunks = get_text_chunks(maze->seed, m.width(), m.height(), style->cell_width, style->cell_height, style->wall_width, m.entrance(), m.exit(), maze->algorithm, true, m.difficulty(), m.solution_branch_count(), m.solution_distance());
+		std::string encoded = img.encode(chunks, compression_level, maze->pool.get());
+
+		// handed out with malloc so it can outlive anything of the library's, and be freed by mkmz_free
+		void *res = std::malloc(encoded.size() ? encoded.size() : 1);
+		if (!res)
+			throw std::bad_alloc();
+		std::memcpy(res, encoded.data(), encoded.size());
+		*png = res;
+		*size = encoded.size();
+	});
+}
+
+void mkmz_free(void *p)
+{
+	std::free(p);
+}
@@ -0,0 +1,153 @@
+#ifndef MKMZ_H
+#define MKMZ_H
+
+// c interface to libmkmz, for making mazes inside another program instead of running mkmz and reading back its png
+// every function that can fail returns a mkmz_status, and mkmz_last_error describes the last failure on the calling thread
+// a maze may only be used by one thread at a time, but different mazes can be used from different threads at once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// changes whenever a function or struct of this header changes in a way that breaks callers built against an older one
+#define MKMZ_ABI_VERSION 1
+
+typedef enum mkmz_status
+{
+    MKMZ_OK = 0,
+    MKMZ_INVALID_ARGUMENT = 1,
+    MKMZ_OUT_OF_MEMORY = 2,
+    // the maze has to be generated first
+    MKMZ_NOT_GENERATED = 3,
+    MKMZ_FAILED = 4,
+} mkmz_status;
+
+// same algorithms as the command line
+typedef enum mkmz_algorithm
+{
+    MKMZ_RECURSIVE_BACKTRACKER = 0,
+    MKMZ_PARALLEL_BACKTRACKER = 1,
+    MKMZ_WILSONS = 2,
+    MKMZ_PARALLEL_WILSONS = 3,
+    MKMZ_RECURSIVE_DIVISION = 4,
+    MKMZ_KRUSKALS = 5,
+    MKMZ_ELLERS = 6,
+} mkmz_algorithm;
+
+typedef enum mkmz_direction
+{
+    MKMZ_UP = 0,
+    MKMZ_RIGHT = 1,
+    MKMZ_DOWN = 2,
+    MKMZ_LEFT = 3,
+} mkmz_direction;
+
+// number of channels of a pixel
+typedef enum mkmz_color_type
+{
+    MKMZ_GRAY = 1,
+    MKMZ_GRAY_ALPHA = 2,
+    MKMZ_RGB = 3,
+    MKMZ_RGBA = 4,
+} mkmz_color_type;
+
+typedef struct mkmz_maze mkmz_maze;
+
+// what generating a maze found out about it
+typedef struct mkmz_analysis
+{
+    uint32_t seed;
+    uint64_t entrance_x, entrance_y;
+    uint64_t exit_x, exit_y;
+    double difficulty;
+    uint64_t solution_branch_count;
+    uint64_t solution_distance;
+} mkmz_analysis;
+
+// how a maze is drawn, see mkmz_style_default
+typedef struct mkmz_style
+{
+    // in pixels
+    uint64_t cell_width, cell_height;
+    uint64_t wall_width;
+    // r, g, b, a
+    uint8_t wall_color[4];
+    uint8_t cell_color[4];
+} mkmz_style;
+
+// layout of the pixels mkmz_render writes, the same as the rows of a png
+// 8 bit channels are stored in r, g, b, a order, 1 bit gray pixels are packed into bytes starting at the highest bit, the leftmost pixel in bit 7
+typedef struct mkmz_image_format
+{
+    uint64_t width, height;
+    int depth;
+    mkmz_color_type color_type;
+    // smallest stride mkmz_render accepts, a multiple of 8
+    uint64_t row_bytes;
+} mkmz_image_format;
+
+// MKMZ_ABI_VERSION of the library, which may be newer than the header a caller was built with
+int mkmz_abi_version(void);
+
+// message of the last failure on the calling thread, empty if nothing has failed, valid until the next failure on the thread
+const char *mkmz_last_error(void);
+
+/// @brief makes a maze that hasn't been generated yet
+/// @param width width of the maze in cells, at least 2
+/// @param height height of the maze in cells, at least 2
+/// @param maze receives the maze, which has to be freed with mkmz_maze_destroy
+mkmz_status mkmz_maze_create(uint64_t width, uint64_t height, mkmz_maze **maze);
+// maze may be null
+void mkmz_maze_destroy(mkmz_maze *maze);
+
+// number of threads generating, analysing, rendering and encoding use, 1 by default
+mkmz_status mkmz_maze_set_threads(mkmz_maze *maze, unsigned int threads);
+// stores the maze in square tiles, takes effect the next time it's generated
+// only faster once a row of the maze no longer fits in cache, about a million cells wide, and a little slower below that
+mkmz_status mkmz_maze_set_tiled(mkmz_maze *maze, int tiled);
+
+/// @brief generates and analyses the maze, replacing the one it held
+/// @param seed seed to generate with, or null for a random one
+mkmz_status mkmz_maze_generate(mkmz_maze *maze, mkmz_algorithm algorithm, const uint32_t *seed);
+
+uint64_t mkmz_maze_width(const mkmz_maze *maze);
+uint64_t mkmz_maze_height(const mkmz_maze *maze);
+
+// open receives 1 if the wall of cell x, y in direction dir is open, 0 if it's closed
+mkmz_status mkmz_maze_is_open(const mkmz_maze *maze, uint64_t x, uint64_t y, mkmz_direction dir, int *open);
+
+/// @brief reads the walls of a whole row at once
+/// @param up receives one bit per cell, set if the wall above the cell is open, must hold (width + 63) / 64 words
+/// @param right receives one bit per cell, set if the wall right of the cell is open, must hold (width + 63) / 64 words
+mkmz_status mkmz_maze_get_row(const mkmz_maze *maze, uint64_t y, uint64_t *up, uint64_t *right);
+
+mkmz_status mkmz_maze_analysis(const mkmz_maze *maze, mkmz_analysis *analysis);
+
+// 1x1 cells, walls 1 wide, black walls and white cells, like the command line
+void mkmz_style_default(mkmz_style *style);
+
+// the smallest format that holds both colors of style, the same one the command line picks
+mkmz_status mkmz_image_format_of(const mkmz_maze *maze, const mkmz_style *style, mkmz_image_format *format);
+
+/// @brief draws the maze into a buffer of the caller's
+/// @param pixels buffer of at least stride * height bytes, aligned to 8 bytes, in the layout mkmz_image_format_of gives
+/// @param stride distance between rows in bytes, a multiple of 8 of at least row_bytes
+mkmz_status mkmz_render(const mkmz_maze *maze, const mkmz_style *style, void *pixels, uint64_t stride);
+
+/// @brief draws the maze and encodes it as a png in memory, with the same text chunks the command line writes
+/// @param compression_level 0 to 9
+/// @param png receives the png, which has to be freed with mkmz_free
+/// @param size receives the size of the png in bytes
+mkmz_status mkmz_encode_png(const mkmz_maze *maze, const mkmz_style *style, int compression_level, void **png, size_t *size);
+
+// frees memory the library handed out, p may be null
+void mkmz_free(void *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
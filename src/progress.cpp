@@ -0,0 +1,68 @@
+#include "progress.h"
+
+#include <algorithm>
+
+progress_reporter::progress_reporter(std::function<void(double)> callback, std::uint64_t total, const thread_pool *pool) :
+	m_callback{std::move(callback)},
+	m_total{total},
+	m_pool{pool},
+	m_counters{},
+	m_counter_count{pool ? pool->size() : 1u},
+	m_finished{}
+{
+	if (!m_callback)
+		return;
+
+	m_counters = std::make_unique<counter[]>(m_counter_count);
+	for (std::size_t i = 0; i < m_counter_count; ++i)
+		m_counters[i].value.store(0, std::memory_order_relaxed);
+
+	m_thread = std::thread(&progress_reporter::report, this);
+}
+
+progress_reporter::~progress_reporter()
+{
+	finish();
+}
+
+void progress_reporter::finish()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		const std::lock_guard lock(m_lock);
+		m_finished = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+void progress_reporter::report()
+{
+	std::uint64_t last = -1;
+	bool finished = false;
+
+	std::unique_lock lock(m_lock);
+	for (;;)
+	{
+		std::uint64_t done = 0;
+		for (std::size_t i = 0; i < m_counter_count; ++i)
+			done += m_counters[i].value.load(std::memory_order_relaxed);
+		done = std::min(done, m_total);
+
+		// the last report is made even if nothing changed, a job that stopped early reports how far it got instead of 1
+		if (done != last || finished)
+		{
+			// the job doesn't wait for the callback
+			lock.unlock();
+			m_callback(m_total ? static_cast<double>(done) / m_total : 1.0);
+			lock.lock();
+			last = done;
+		}
+
+		if (finished)
+			break;
+		finished = m_wake.wait_for(lock, interval, [this] { return m_finished; });
+	}
+}
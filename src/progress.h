@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "thread_pool.h"
+
+// reports how far along a job is to a callback, from a thread of its own
+// every thread of the pool adds to a counter on a cache line of its own so they never fight over one, the reporting thread adds them up
+// the reporting thread sleeps on a condition variable, so it wakes up as soon as the job finishes instead of after its next sleep
+// without a callback there's no thread and no counters, and adding is a test of a pointer
+class progress_reporter
+{
+public:
+    // time between reports while the job runs
+    static constexpr std::chrono::milliseconds interval{100};
+
+    /// @brief starts reporting, with a first report of 0
+    /// @param callback function who takes a double between 0 and 1 representing progress, may be empty
+    /// @param total amount of work in the whole job
+    /// @param pool threads of pool get counters of their own, every other thread shares one
+    progress_reporter(std::function<void(double)> callback, std::uint64_t total, const thread_pool *pool = nullptr);
+    // finishes the job if it isn't finished yet, so a job that throws stops being reported
+    ~progress_reporter();
+
+    progress_reporter(const progress_reporter &) = delete;
+    progress_reporter &operator=(const progress_reporter &) = delete;
+
+    // false if there's no callback, so counting can be skipped
+    inline bool active() const { return m_counters != nullptr; }
+
+    // safe from any thread
+    inline void add(std::uint64_t amount)
+    {
+        if (!m_counters)
+            return;
+        std::size_t i = m_pool ? m_pool->thread_index() : 0;
+        m_counters[i].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // makes the last report straight away and waits for the reporting thread to stop, nothing should be added after this
+    void finish();
+
+private:
+    struct alignas(64) counter
+    {
+        std::atomic<std::uint64_t> value;
+    };
+
+    std::function<void(double)> m_callback;
+    std::uint64_t m_total;
+    const thread_pool *m_pool;
+    std::unique_ptr<counter[]> m_counters;
+    std::size_t m_counter_count;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    bool m_finished;
+    std::thread m_thread;
+
+    void report();
+};
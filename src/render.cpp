@@ -0,0 +1,374 @@
+#include "render.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+std::vector<uint64_t> make_expand_table(uint64_t period, uint64_t run)
+{
+	std::vector<uint64_t> table(256);
+	uint64_t run_bits = run == 64 ? static_cast<uint64_t>(-1) : (uint64_t{1} << run) - 1;
+	for (unsigned int b = 0; b < 256; ++b)
+		for (unsigned int i = 0; i < 8; ++i)
+			if (b & (1 << i))
+				table[b] |= run_bits << (period * i);
+	return table;
+}
+
+// sets len bits of row starting at bit pos
+inline void set_bits(image::base_t *row, uint64_t pos, uint64_t len)
+{
+	while (len)
+	{
+		uint64_t off = pos % 64;
+		uint64_t n = std::min(len, 64 - off);
+		row[pos / 64] |= (n == 64 ? static_cast<uint64_t>(-1) : (uint64_t{1} << n) - 1) << off;
+		pos += n;
+		len -= n;
+	}
+}
+
+namespace
+{
+	// 0 is never a renderer's id
+	std::atomic<uint64_t> next_id{1};
+}
+
+maze_renderer::maze_renderer(const maze &mz, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, const uint16_t *wall_color, const uint16_t *cell_color, int depth, color_t col) :
+	maze_renderer([&mz](maze::len_t y, uint64_t *up, uint64_t *right) { mz.get_row(y, up, right); }, mz.width(), mz.height(), mz.entrance(), mz.exit(), cell_width, cell_height, wall_width, wall_color, cell_color, depth, col)
+{
+}
+
+maze_renderer::maze_renderer(row_source rows, maze::len_t maze_width, maze::len_t maze_height, pt entrance, pt exit, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, const uint16_t *wall_color, const uint16_t *cell_color, int depth, color_t col) :
+	m_id{next_id.fetch_add(1, std::memory_order_relaxed)},
+	m_rows{std::move(rows)},
+	m_maze_width{maze_width}, m_maze_height{maze_height},
+	m_entrance{entrance}, m_exit{exit},
+	m_cell_width{cell_width}, m_cell_height{cell_height},
+	m_wall_width{wall_width},
+	m_width{(cell_width + wall_width) * maze_width + wall_width},
+	m_height{(cell_height + wall_width) * maze_height + wall_width},
+	m_depth{depth}, m_col{col}
+{
+	for (int c = 0; c < 4; ++c)
+	{
+		m_wall_color[c] = wall_color[c];
+		m_cell_color[c] = cell_color[c];
+	}
+
+	uint64_t period = cell_width + wall_width;
+	if (depth == 1 && period <= 8)
+	{
+		m_period_table = make_expand_table(period, period);
+		m_wall_table = make_expand_table(period, wall_width);
+	}
+}
+
+void maze_renderer::render_row(uint64_t y, image::base_t *row) const
+{
+	if (y >= m_height)
+		throw std::runtime_error("Pixel out of range");
+
+	if (m_depth == 1)
+	{
+		render_row_1bit(y, row);
+		return;
+	}
+
+	// clear row to cell color and draw right wall
+	fill(row, 0, m_width - m_wall_width, m_cell_color);
+	fill(row, m_width - m_wall_width, m_wall_width, m_wall_color);
+
+	maze::len_t mz_y = y / (m_cell_height + m_wall_width);
+	// true if y passes through the bottom walls of the maze row
+	bool wall_row = y % (m_cell_height + m_wall_width) < m_wall_width;
+
+	// bottom line
+	if (mz_y == m_maze_height)
+	{
+		fill(row, 0, m_width, m_wall_color);
+	}
+	else
+	{
+		uint64_t cell_words = (m_maze_width + 63) / 64;
+
+		thread_local std::vector<uint64_t> scratch;
+		scratch.resize(cell_words * 6);
+		uint64_t *up = scratch.data();
+		uint64_t *right = up + cell_words;
+		uint64_t *left_closed = right + cell_words;
+		// the same for the row below
+		uint64_t *below_up = left_closed + cell_words;
+		uint64_t *below_right = below_up + cell_words;
+		uint64_t *below_left_closed = below_right + cell_words;
+
+		std::fill(left_closed, left_closed + cell_words, 0);
+		read_row(mz_y, up, right, left_closed);
+		if (wall_row && mz_y)
+		{
+			std::fill(below_left_closed, below_left_closed + cell_words, 0);
+			read_row(mz_y - 1, below_up, below_right, below_left_closed);
+		}
+
+		auto bit = [](const uint64_t *bits, maze::len_t x) { return (bits[x / 64] >> (x % 64)) & 1; };
+
+		for (maze::len_t x = 0; x < m_maze_width; ++x)
+		{
+			auto image_x = (m_cell_width + m_wall_width) * x;
+
+			if (wall_row)
+			{
+				// bottom wall, overlaps both neighbouring left walls
+				if (!mz_y || !bit(below_up, x))
+					fill(row, image_x, m_cell_width + 2 * m_wall_width, m_wall_color);
+
+				// left wall of the cell below reaches into this row
+				if (mz_y && bit(below_left_closed, x))
+					fill(row, image_x, m_wall_width, m_wall_color);
+			}
+
+			// left wall
+			if (bit(left_closed, x))
+				fill(row, image_x, m_wall_width, m_wall_color);
+		}
+	}
+
+	draw_exit(row, y, m_entrance);
+	draw_exit(row, y, m_exit);
+}
+
+uint64_t maze_renderer::repeats(uint64_t y) const
+{
+	uint64_t period = m_cell_height + m_wall_width;
+
+	// bottom line
+	if (y / period == m_maze_height)
+		return m_height - y;
+
+	uint64_t off = y % period;
+	return off < m_wall_width ? m_wall_width - off : period - off;
+}
+
+const image::base_t *maze_renderer::render_row_cached(uint64_t y) const
+{
+	// the run of rows rendered last on this thread is known by its renderer and the row after it
+	thread_local uint64_t last_id = 0;
+	thread_local uint64_t last_end = 0;
+	thread_local std::vector<image::base_t> last_row;
+
+	uint64_t end = y + repeats(y);
+	if (last_id != m_id || last_end != end)
+	{
+		last_row.resize(row_len());
+		// a row that throws isn't left looking rendered
+		last_id = 0;
+		render_row(y, last_row.data());
+		last_id = m_id;
+		last_end = end;
+	}
+	return last_row.data();
+}
+
+void maze_renderer::read_row(maze::len_t y, uint64_t *up, uint64_t *right, uint64_t *left_closed) const
+{
+	uint64_t cells = m_maze_width;
+	uint64_t cell_words = (cells + 63) / 64;
+	// bits past the last cell must stay clear
+	uint64_t last_mask = cells % 64 ? (uint64_t{1} << (cells % 64)) - 1 : static_cast<uint64_t>(-1);
+
+	m_rows(y, up, right);
+
+	// the left wall of a cell is the right wall of the cell before it, and the first cell's is always closed
+	for (uint64_t i = cell_words; i--;)
+	{
+		uint64_t open = (right[i] << 1) | (i ? right[i - 1] >> 63 : 0);
+		left_closed[i] |= ~open;
+	}
+	left_closed[0] |= 1;
+	left_closed[cell_words - 1] &= last_mask;
+}
+
+void maze_renderer::render_row_1bit(uint64_t y, image::base_t *row) const
+{
+	uint64_t words = row_len();
+	uint64_t cells = m_maze_width;
+	uint64_t cell_words = (cells + 63) / 64;
+	// bits past the last cell must stay clear
+	uint64_t last_mask = cells % 64 ? (uint64_t{1} << (cells % 64)) - 1 : static_cast<uint64_t>(-1);
+
+	maze::len_t mz_y = y / (m_cell_height + m_wall_width);
+	bool wall_row = y % (m_cell_height + m_wall_width) < m_wall_width;
+
+	bool wall_bit = m_wall_color[0];
+	bool cell_bit = m_cell_color[0];
+
+	// bottom line, or walls that look the same as cells
+	if (mz_y == m_maze_height || wall_bit == cell_bit)
+	{
+		std::fill(row, row + words, 0);
+		fill(row, 0, m_width, mz_y == m_maze_height ? m_wall_color : m_cell_color);
+		fill(row, m_width - m_wall_width, m_wall_width, m_wall_color);
+		draw_exit(row, y, m_entrance);
+		draw_exit(row, y, m_exit);
+		return;
+	}
+
+	thread_local std::vector<uint64_t> scratch;
+	scratch.resize(cell_words * 4);
+	uint64_t *up = scratch.data();
+	uint64_t *right = up + cell_words;
+	uint64_t *left_closed = right + cell_words;
+	uint64_t *down_closed = left_closed + cell_words;
+
+	std::fill(row, row + words, 0);
+	std::fill(left_closed, left_closed + cell_words, 0);
+
+	if (wall_row)
+	{
+		// left walls of the cells below reach into this row
+		if (mz_y)
+		{
+			read_row(mz_y - 1, up, right, left_closed);
+			for (uint64_t i = 0; i < cell_words; ++i)
+				down_closed[i] = ~up[i];
+		}
+		else
+			std::fill(down_closed, down_closed + cell_words, static_cast<uint64_t>(-1));
+		down_closed[cell_words - 1] &= last_mask;
+
+		// bottom walls cover the cell and the walls on both sides of it
+		uint64_t period = m_cell_width + m_wall_width;
+		expand(down_closed, m_period_table, period, 0, row);
+		expand(down_closed, m_wall_table, m_wall_width, period, row);
+	}
+
+	read_row(mz_y, up, right, left_closed);
+	expand(left_closed, m_wall_table, m_wall_width, 0, row);
+
+	// row holds set bits where walls are
+	if (!wall_bit)
+	{
+		for (uint64_t i = 0; i < words; ++i)
+			row[i] = ~row[i];
+		if (m_width % 64)
+			row[words - 1] &= (uint64_t{1} << (m_width % 64)) - 1;
+	}
+
+	fill(row, m_width - m_wall_width, m_wall_width, m_wall_color);
+
+	draw_exit(row, y, m_entrance);
+	draw_exit(row, y, m_exit);
+}
+
+void maze_renderer::expand(const uint64_t *bits, const std::vector<uint64_t> &table, uint64_t run, uint64_t shift, image::base_t *row) const
+{
+	uint64_t period = m_cell_width + m_wall_width;
+	uint64_t cells = m_maze_width;
+
+	if (!table.empty())
+	{
+		// 8 cells at a time through the table
+		for (uint64_t x = 0; x < cells; x += 8)
+		{
+			auto byte = static_cast<unsigned int>(bits[x / 64] >> (x % 64)) & 0xff;
+			if (!byte)
+				continue;
+
+			uint64_t pattern = table[byte];
+			uint64_t pos = shift + period * x;
+			row[pos / 64] |= pattern << (pos % 64);
+			if (pos % 64)
+			{
+				// only touch the next word if the pattern reaches it, it may be past the end of the row
+				uint64_t high = pattern >> (64 - pos % 64);
+				if (high)
+					row[pos / 64 + 1] |= high;
+			}
+		}
+	}
+	else
+	{
+		// wide cells, every run covers at least most of a byte anyway
+		for (uint64_t w = 0; w * 64 < cells; ++w)
+			for (uint64_t b = bits[w]; b; b &= b - 1)
+				set_bits(row, shift + period * (w * 64 + std::countr_zero(b)), run);
+	}
+}
+
+void maze_renderer::draw_exit(image::base_t *row, uint64_t y, pt p) const
+{
+	// left and right exits span the cell rows of p
+	uint64_t side_y = (m_cell_height + m_wall_width) * p.y + m_wall_width;
+	bool in_side = y >= side_y && y < side_y + m_cell_height;
+
+	// if on left wall
+	if (p.x == 0)
+	{
+		if (in_side)
+			fill(row, 0, m_wall_width, m_cell_color);
+	}
+	// if on right wall
+	else if (p.x == m_maze_width - 1)
+	{
+		if (in_side)
+			fill(row, (m_cell_width + m_wall_width) * p.x + m_cell_width + m_wall_width, m_wall_width, m_cell_color);
+	}
+	// if on top wall
+	else if (p.y == 0)
+	{
+		if (y < m_wall_width)
+			fill(row, (m_cell_width + m_wall_width) * p.x + m_wall_width, m_cell_width, m_cell_color);
+	}
+	// if on bottom wall
+	else if (p.y == m_maze_height - 1)
+	{
+		uint64_t image_y = (m_cell_height + m_wall_width) * p.y + m_cell_height + m_wall_width;
+		if (y >= image_y && y < image_y + m_wall_width)
+			fill(row, (m_cell_width + m_wall_width) * p.x + m_wall_width, m_cell_width, m_cell_color);
+	}
+}
+
+void render_image(const maze_renderer &renderer, image &img, thread_pool &pool, progress_reporter *prog)
+{
+	// small tasks, so threads that finish early can take over work from the others
+	constexpr uint64_t rows_per_task = 64;
+
+	// every task owns a strip of rows, so nothing has to be locked
+	pool.parallel_for(0, img.height(), rows_per_task, [&](uint64_t first, uint64_t last) {
+		image::strip s = img.get_strip(first, last);
+		render_rows(renderer, s.first(), s.last(), [&s](uint64_t y) { return s.row(y); });
+		if (prog)
+			prog->add(last - first);
+	});
+}
+
+void pick_format(const uint16_t *wall_color, const uint16_t *cell_color, int &depth, color_t &col)
+{
+	auto is_gray = [](const uint16_t *color) { return color[0] == color[1] && color[0] == color[2]; };
+
+	if (is_gray(wall_color) && is_gray(cell_color))
+	{
+		if (wall_color[3] == 255 && cell_color[3] == 255)
+		{
+			if ((wall_color[0] == 0 || wall_color[0] == 255) &&
+				(cell_color[0] == 0 || cell_color[0] == 255))
+				depth = 1;
+			else
+				depth = 8;
+			col = color_t::gray;
+		}
+		else
+		{
+			depth = 8;
+			col = color_t::gray_alpha;
+		}
+	}
+	else
+	{
+		depth = 8;
+		if (wall_color[3] == 255 && cell_color[3] == 255)
+			col = color_t::rgb;
+		else
+			col = color_t::rgba;
+	}
+}
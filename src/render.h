@@ -0,0 +1,117 @@
+#pragma once
+#include "maze.h"
+#include "image.h"
+#include "progress.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// produces the pixel rows of a maze image on demand, so the full image never has to be stored
+// the maze must outlive the renderer
+class maze_renderer
+{
+public:
+    // reads a row of the maze in the same format as maze::get_row, called from every thread that renders
+    using row_source = std::function<void(maze::len_t y, uint64_t *up, uint64_t *right)>;
+
+    maze_renderer(const maze &mz, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, const uint16_t *wall_color, const uint16_t *cell_color, int depth, color_t col);
+
+    // renders a maze that isn't stored, rows are read from rows as they're needed
+    // rendering pixel row y reads maze rows y / (cell_height + wall_width) and the one before it
+    maze_renderer(row_source rows, maze::len_t maze_width, maze::len_t maze_height, pt entrance, pt exit, uint64_t cell_width, uint64_t cell_height, uint64_t wall_width, const uint16_t *wall_color, const uint16_t *cell_color, int depth, color_t col);
+
+    inline uint64_t width() const { return m_width; }
+    inline uint64_t height() const { return m_height; }
+    inline int depth() const { return m_depth; }
+    inline color_t color() const { return m_col; }
+
+    // number of image::base_t's needed to hold one row
+    inline uint64_t row_len() const { return image::row_len(m_width, m_depth, m_col); }
+
+    /// @brief renders pixel row y of the image
+    /// @param y row of the image
+    /// @param row buffer of at least row_len() elements to render into
+    void render_row(uint64_t y, image::base_t *row) const;
+
+    // number of rows from y on that are the same as row y, at least 1
+    // every maze row is wall_width identical rows followed by cell_height identical rows, exits included
+    uint64_t repeats(uint64_t y) const;
+
+    // renders pixel row y, unless the last row this thread rendered with render_row_cached is the same, which is returned as it is
+    // the row is valid until this thread calls render_row_cached again
+    const image::base_t *render_row_cached(uint64_t y) const;
+
+private:
+    // tells rows rendered by different renderers apart
+    uint64_t m_id;
+
+    row_source m_rows;
+    maze::len_t m_maze_width, m_maze_height;
+    pt m_entrance, m_exit;
+
+    uint64_t m_cell_width, m_cell_height;
+    uint64_t m_wall_width;
+
+    uint16_t m_wall_color[4];
+    uint16_t m_cell_color[4];
+
+    // in pixels
+    uint64_t m_width, m_height;
+    int m_depth;
+    color_t m_col;
+
+    // for cells up to 8 pixels wide, maps 8 cells' bits to runs of pixels starting at each cell
+    // one table for runs as wide as a cell + wall, one for runs as wide as a wall
+    std::vector<uint64_t> m_period_table;
+    std::vector<uint64_t> m_wall_table;
+
+    inline void fill(image::base_t *row, uint64_t x, uint64_t len, const uint16_t *color) const
+    {
+        image::fill_row(row, x, len, m_depth, m_col, color);
+    }
+
+    // reads maze row y into up and right, and sets left_closed where the cells' left walls are closed
+    void read_row(maze::len_t y, uint64_t *up, uint64_t *right, uint64_t *left_closed) const;
+
+    // depth 1 rows are built a word at a time from the maze's row bits
+    void render_row_1bit(uint64_t y, image::base_t *row) const;
+
+    // sets run bits of row at shift + (cell_width + wall_width) * x for every bit x set in bits
+    void expand(const uint64_t *bits, const std::vector<uint64_t> &table, uint64_t run, uint64_t shift, image::base_t *row) const;
+
+    // opens p in the outer wall if row y passes through its opening
+    void draw_exit(image::base_t *row, uint64_t y, pt p) const;
+};
+
+/// @brief renders every row of img, in strips of rows spread over the pool
+/// @param renderer renderer with the same dimensions, depth and color type as img
+/// @param img image to render into
+/// @param pool threads to render with
+/// @param prog if not null, rows are added to it as they finish
+void render_image(const maze_renderer &renderer, image &img, thread_pool &pool, progress_reporter *prog = nullptr);
+
+/// @brief renders rows [first, last), drawing each run of identical rows once and copying it to the rest of the run
+/// @param renderer renderer to draw with
+/// @param row function that takes a row index and returns the buffer of that row, of at least renderer.row_len() elements
+template <typename row_fun_t>
+void render_rows(const maze_renderer &renderer, uint64_t first, uint64_t last, row_fun_t row)
+{
+    uint64_t len = renderer.row_len();
+    for (uint64_t y = first; y < last;)
+    {
+        image::base_t *src = row(y);
+        renderer.render_row(y, src);
+
+        uint64_t end = std::min(last, y + renderer.repeats(y));
+        for (++y; y < end; ++y)
+            std::copy(src, src + len, row(y));
+    }
+}
+
+/// @brief picks the smallest image format that holds both colors
+/// @param wall_color rgba color of the walls
+/// @param cell_color rgba color of the cells
+/// @param depth receives the depth
+/// @param col receives the color type
+void pick_format(const uint16_t *wall_color, const uint16_t *cell_color, int &depth, color_t &col);
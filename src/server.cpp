@@ -0,0 +1,551 @@
+#include "server.h"
+#include "algorithm.h"
+#include "image.h"
+#include "render.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+	#define MKMZ_POSIX 1
+	#include <csignal>
+	#include <poll.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+namespace
+{
+	using clock = std::chrono::steady_clock;
+
+	// kept by a worker between requests
+	struct scratch
+	{
+		maze m;
+		image img;
+	};
+
+	std::string number(double value, const char *format = "%.6g")
+	{
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), format, value);
+		return buf;
+	}
+
+	double ms(clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+
+	// start of a response, with the request's id if it has one
+	std::string begin_response(const json_value *request)
+	{
+		std::string res = "{";
+		if (request && request->get_type() == json_value::type::object)
+			if (const json_value *id = request->find("id"))
+			{
+				res += "\"id\": ";
+				res += id->dump();
+				res += ", ";
+			}
+		return res;
+	}
+
+	std::string error_response(const json_value *request, const std::string &what, clock::duration total)
+	{
+		return begin_response(request) + "\"ok\": false, \"error\": " + json_quote(what) + ", \"latency_ms\": {\"total\": " + number(ms(total), "%.3f") + "}}";
+	}
+
+	// runs read on member key of request if it's there, naming key in any error
+	template <typename fun_t>
+	void read_member(const json_value &request, const char *key, fun_t read)
+	{
+		const json_value *value = request.find(key);
+		if (!value)
+			return;
+		try
+		{
+			read(*value);
+		}
+		catch (const std::runtime_error &e)
+		{
+			throw std::runtime_error(std::string(key) + ": " + e.what());
+		}
+	}
+
+	void read_pair(const json_value &request, const char *key, uint64_t &a, uint64_t &b)
+	{
+		read_member(request, key, [&](const json_value &value) {
+			auto &pair = value.as_array();
+			if (pair.size() != 2)
+				throw std::runtime_error("Expected an array of 2 numbers");
+			a = pair[0].as_uint();
+			b = pair[1].as_uint();
+		});
+	}
+
+	// same rules as -wcol and -ccol, omitted g and b are 0 and an omitted a is 255
+	void read_color(const json_value &request, const char *key, uint16_t *color)
+	{
+		read_member(request, key, [&](const json_value &value) {
+			auto &channels = value.as_array();
+			if (channels.empty() || channels.size() > 4)
+				throw std::runtime_error("Expected an array of 1 to 4 numbers");
+			color[1] = color[2] = 0;
+			color[3] = 255;
+			for (std::size_t i = 0; i < channels.size(); ++i)
+			{
+				uint64_t c = channels[i].as_uint();
+				if (c > 255)
+					throw std::runtime_error("Channels range from 0 to 255");
+				color[i] = static_cast<uint16_t>(c);
+			}
+		});
+	}
+
+	algorithm_type read_algorithm(const std::string &name)
+	{
+		// same names as the command line flags
+		static const std::pair<const char *, algorithm_type> names[] = {
+			{"rb", algorithm_type::recursive_backtracker},
+			{"prb", algorithm_type::parallel_backtracker},
+			{"w", algorithm_type::wilsons},
+			{"pw", algorithm_type::parallel_wilsons},
+			{"rd", algorithm_type::recursive_division},
+			{"k", algorithm_type::kruskals},
+			{"e", algorithm_type::ellers},
+		};
+		for (auto &[n, algorithm] : names)
+			if (name == n)
+				return algorithm;
+		throw std::runtime_error("Unknown algorithm " + name);
+	}
+
+	std::string base64(const std::string &data)
+	{
+		static constexpr char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+		std::string res;
+		res.reserve((data.size() + 2) / 3 * 4);
+		std::size_t i = 0;
+		for (; i + 3 <= data.size(); i += 3)
+		{
+			uint32_t n = static_cast<unsigned char>(data[i]) << 16 | static_cast<unsigned char>(data[i + 1]) << 8 | static_cast<unsigned char>(data[i + 2]);
+			res += digits[n >> 18];
+			res += digits[(n >> 12) & 63];
+			res += digits[(n >> 6) & 63];
+			res += digits[n & 63];
+		}
+		if (i < data.size())
+		{
+			uint32_t n = static_cast<unsigned char>(data[i]) << 16;
+			if (i + 1 < data.size())
+				n |= static_cast<unsigned char>(data[i + 1]) << 8;
+			res += digits[n >> 18];
+			res += digits[(n >> 12) & 63];
+			res += i + 1 < data.size() ? digits[(n >> 6) & 63] : '=';
+			res += '=';
+		}
+		return res;
+	}
+
+	std::string point(pt p)
+	{
+		std::string res = "[";
+		res += std::to_string(p.x);
+		res += ", ";
+		res += std::to_string(p.y);
+		res += ']';
+		return res;
+	}
+
+	// makes the maze request asks for with the buffers in s, and returns the response
+	std::string handle(const json_value &request, scratch &s, clock::time_point received, clock::time_point start)
+	{
+		uint64_t maze_width = 0, maze_height = 0;
+		uint64_t cell_width = 1, cell_height = 1;
+		uint64_t wall_width = 1;
+		uint16_t wall_color[4] = {0, 0, 0, 255};
+		uint16_t cell_color[4] = {255, 255, 255, 255};
+		algorithm_type algorithm = algorithm_type::recursive_backtracker;
+		int compression_level = 5;
+		maze::layout layout = maze::layout::row_major;
+		std::string output;
+		bool inline_png = false;
+
+		if (!request.find("dims"))
+			throw std::runtime_error("dims is required");
+		read_pair(request, "dims", maze_width, maze_height);
+		if (maze_width < 2 || maze_height < 2)
+			throw std::runtime_error("Maze width/height must be greater than 1");
+		read_pair(request, "cdims", cell_width, cell_height);
+		read_member(request, "ww", [&](const json_value &v) { wall_width = v.as_uint(); });
+		read_color(request, "wcol", wall_color);
+		read_color(request, "ccol", cell_color);
+		read_member(request, "algorithm", [&](const json_value &v) { algorithm = read_algorithm(v.as_string()); });
+		read_member(request, "clevel", [&](const json_value &v) {
+			if (v.as_uint() > 9)
+				throw std::runtime_error("Compression level ranges from 0 to 9");
+			compression_level = static_cast<int>(v.as_uint());
+		});
+		read_member(request, "tiled", [&](const json_value &v) { layout = v.as_bool() ? maze::layout::tiled : maze::layout::row_major; });
+		read_member(request, "output", [&](const json_value &v) { output = v.as_string(); });
+		read_member(request, "inline", [&](const json_value &v) { inline_png = v.as_bool(); });
+
+		if (output.empty() == !inline_png)
+			throw std::runtime_error("Exactly one of output and inline is required");
+
+		uint64_t image_width = (cell_width + wall_width) * maze_width + wall_width;
+		uint64_t image_height = (cell_height + wall_width) * maze_height + wall_width;
+		if (!image::within_limits(image_width, image_height))
+			throw std::runtime_error("Image width and or height are too large");
+
+		// the seed is read last, so a maze from an earlier request never keeps its seed
+		maze &m = s.m;
+		m.set_dims(maze_width, maze_height);
+		m.set_layout(layout);
+		m.set_seed();
+		read_member(request, "seed", [&](const json_value &v) { m.set_seed(static_cast<uint_least32_t>(v.as_uint())); });
+
+		generate(m, algorithm);
+		auto generated = clock::now();
+
+		int depth;
+		color_t color_type;
+		pick_format(wall_color, cell_color, depth, color_type);
+
+		// the image is only made again if the last request's is a different size or format
+		if (s.img.width() != image_width || s.img.height() != image_height || s.img.depth() != static_cast<uint64_t>(depth) || s.img.color() != color_type)
+		{
+			s.img = image();
+			s.img = image(image_width, image_height, depth, color_type);
+		}
+
+		maze_renderer renderer(m, cell_width, cell_height, wall_width, wall_color, cell_color, depth, color_type);
+		render_rows(renderer, 0, image_height, [&s](uint64_t y) { return s.img.row(y); });
+		auto rendered = clock::now();
+
+		uint_least32_t seed = m.get_seed();
+		auto chunks = get_text_chunks(seed, maze_width, maze_height, cell_width, cell_height, wall_width, m.entrance(), m.exit(), algorithm, true, m.difficulty(), m.solution_branch_count(), m.solution_distance());
+
+		std::string res = begin_response(&request);
+		res += "\"ok\": true";
+		res += ", \"seed\": " + std::to_string(seed);
+		res += ", \"image_width\": " + std::to_string(image_width);
+		res += ", \"image_height\": " + std::to_string(image_height);
+		res += ", \"entrance\": " + point(m.entrance());
+		res += ", \"exit\": " + point(m.exit());
+		res += ", \"difficulty\": " + number(m.difficulty());
+		res += ", \"solution_branch_count\": " + std::to_string(m.solution_branch_count());
+		res += ", \"solution_distance\": " + std::to_string(m.solution_distance());
+
+		if (inline_png)
+		{
+			std::string png = s.img.encode(chunks, compression_level);
+			res += ", \"bytes\": " + std::to_string(png.size());
+			res += ", \"png\": \"" + base64(png) + '"';
+		}
+		else
+		{
+			uint64_t bytes = s.img.write(output, chunks, compression_level);
+			res += ", \"bytes\": " + std::to_string(bytes);
+			res += ", \"output\": " + json_quote(output);
+		}
+		auto encoded = clock::now();
+
+		res += ", \"latency_ms\": {";
+		res += "\"queue\": " + number(ms(start - received), "%.3f");
+		res += ", \"generate\": " + number(ms(generated - start), "%.3f");
+		res += ", \"render\": " + number(ms(rendered - generated), "%.3f");
+		res += ", \"encode\": " + number(ms(encoded - rendered), "%.3f");
+		res += ", \"total\": " + number(ms(encoded - received), "%.3f");
+		res += "}}";
+		return res;
+	}
+
+#ifdef MKMZ_POSIX
+	// a client of the socket, closed once the reader and every response that's still to come are done with it
+	struct connection
+	{
+		int fd;
+		// one response is written at a time, so lines from different workers don't mix
+		std::mutex lock;
+
+		inline explicit connection(int fd) : fd{fd} {}
+		inline ~connection() { ::close(fd); }
+
+		// a client that's gone just doesn't get the response
+		void send_line(const std::string &line)
+		{
+			std::string msg = line + '\n';
+			const std::lock_guard guard(lock);
+			for (std::size_t sent = 0; sent < msg.size();)
+			{
+				ssize_t n = ::send(fd, msg.data() + sent, msg.size() - sent, 0);
+				if (n < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return;
+				}
+				sent += n;
+			}
+		}
+	};
+#endif
+
+	bool blank(const std::string &line)
+	{
+		return line.find_first_not_of(" \t\r") == std::string::npos;
+	}
+}
+
+maze_server::maze_server(thread_pool &pool) : m_pool{pool}, m_closed{false}
+{
+}
+
+bool maze_server::socket_supported()
+{
+#ifdef MKMZ_POSIX
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool maze_server::push(const std::string &line, std::function<void(const std::string &)> respond)
+{
+	job j;
+	j.received = clock::now();
+
+	// requests that can't be made are answered straight away
+	if (line.size() > max_request_len)
+	{
+		respond(error_response(nullptr, "Request too long", clock::now() - j.received));
+		return true;
+	}
+	try
+	{
+		j.request = json_value::parse(line);
+		if (j.request.get_type() != json_value::type::object)
+			throw std::runtime_error("Expected an object");
+	}
+	catch (const std::runtime_error &e)
+	{
+		respond(error_response(nullptr, e.what(), clock::now() - j.received));
+		return true;
+	}
+
+	if (const json_value *command = j.request.find("command"))
+	{
+		if (command->get_type() != json_value::type::string || command->as_string() != "shutdown")
+		{
+			respond(error_response(&j.request, "Unknown command", clock::now() - j.received));
+			return true;
+		}
+
+		// requests already queued are still answered
+		respond(begin_response(&j.request) + "\"ok\": true}");
+		close();
+		return false;
+	}
+
+	j.respond = std::move(respond);
+	{
+		const std::lock_guard lock(m_lock);
+		m_jobs.push_back(std::move(j));
+	}
+	m_ready.notify_one();
+	return true;
+}
+
+bool maze_server::pop(job &j)
+{
+	std::unique_lock lock(m_lock);
+	m_ready.wait(lock, [this] { return m_closed || !m_jobs.empty(); });
+	if (m_jobs.empty())
+		return false;
+	j = std::move(m_jobs.front());
+	m_jobs.pop_front();
+	return true;
+}
+
+void maze_server::close()
+{
+	{
+		const std::lock_guard lock(m_lock);
+		m_closed = true;
+	}
+	m_ready.notify_all();
+}
+
+void maze_server::work()
+{
+	// one worker per thread of the pool, each running until the queue is closed
+	m_pool.parallel_for(0, m_pool.size(), 1, [this](uint64_t, uint64_t) {
+		scratch s;
+		job j;
+		while (pop(j))
+		{
+			auto start = clock::now();
+			std::string res;
+			try
+			{
+				res = handle(j.request, s, j.received, start);
+			}
+			catch (const std::bad_alloc &)
+			{
+				// the buffers may be what's too big, so they're let go
+				s = scratch();
+				res = error_response(&j.request, "Couldn't allocate enough memory", clock::now() - j.received);
+			}
+			catch (const std::exception &e)
+			{
+				res = error_response(&j.request, e.what(), clock::now() - j.received);
+			}
+			j.respond(res);
+		}
+	});
+}
+
+void maze_server::serve(std::istream &in, std::ostream &out)
+{
+	std::mutex out_lock;
+	auto respond = [&out, &out_lock](const std::string &line) {
+		const std::lock_guard lock(out_lock);
+		out << line << '\n';
+		// the client is probably waiting for this response before sending more
+		out.flush();
+	};
+
+	std::thread reader([&] {
+		std::string line;
+		while (std::getline(in, line))
+			if (!blank(line) && !push(line, respond))
+				return;
+		close();
+	});
+
+	work();
+	reader.join();
+}
+
+void maze_server::serve_socket(const std::string &path)
+{
+#ifndef MKMZ_POSIX
+	(void)path;
+	throw std::runtime_error("Unix sockets aren't supported on this platform");
+#else
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error("Socket path is too long");
+	std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+	// left behind by a server that didn't shut down
+	std::error_code ec;
+	if (std::filesystem::is_socket(path, ec))
+		std::filesystem::remove(path, ec);
+
+	int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		throw std::runtime_error("Could not make a socket");
+	if (::bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) || ::listen(listener, SOMAXCONN))
+	{
+		::close(listener);
+		throw std::runtime_error("Could not listen on " + path);
+	}
+
+	// writing to a client that hung up fails instead of ending the server
+	std::signal(SIGPIPE, SIG_IGN);
+
+	// one thread reads from every connection, requests are small so it's never the bottleneck
+	std::thread reader([&] {
+		std::vector<pollfd> fds{{listener, POLLIN, 0}};
+		// clients[i] and buffers[i] go with fds[i + 1], a buffer holds the part of a line that hasn't been read yet
+		std::vector<std::shared_ptr<connection>> clients;
+		std::vector<std::string> buffers;
+
+		bool running = true;
+		while (running)
+		{
+			if (::poll(fds.data(), fds.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+
+			for (std::size_t i = fds.size(); running && i-- > 1;)
+			{
+				if (!fds[i].revents)
+					continue;
+
+				char buf[1 << 16];
+				ssize_t n = ::recv(fds[i].fd, buf, sizeof(buf), 0);
+				if (n < 0 && errno == EINTR)
+					continue;
+
+				bool hung_up = n <= 0;
+				if (!hung_up)
+				{
+					auto client = clients[i - 1];
+					std::string &pending = buffers[i - 1];
+					pending.append(buf, n);
+
+					std::size_t first = 0;
+					std::size_t end;
+					while (running && (end = pending.find('\n', first)) != std::string::npos)
+					{
+						std::string line = pending.substr(first, end - first);
+						first = end + 1;
+						if (!blank(line))
+							running = push(line, [client](const std::string &res) { client->send_line(res); });
+					}
+					pending.erase(0, first);
+
+					if (pending.size() > max_request_len)
+					{
+						client->send_line(error_response(nullptr, "Request too long", {}));
+						hung_up = true;
+					}
+				}
+
+				if (hung_up)
+				{
+					// responses still on their way keep the connection open
+					fds.erase(fds.begin() + i);
+					clients.erase(clients.begin() + (i - 1));
+					buffers.erase(buffers.begin() + (i - 1));
+				}
+			}
+
+			if (running && (fds[0].revents & POLLIN))
+			{
+				int fd = ::accept(listener, nullptr, nullptr);
+				if (fd >= 0)
+				{
+					fds.push_back({fd, POLLIN, 0});
+					clients.push_back(std::make_shared<connection>(fd));
+					buffers.emplace_back();
+				}
+			}
+		}
+
+		close();
+	});
+
+	work();
+	reader.join();
+
+	::close(listener);
+	std::filesystem::remove(path, ec);
+#endif
+}
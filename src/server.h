@@ -0,0 +1,65 @@
+#pragma once
+#include "thread_pool.h"
+#include "json.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// makes mazes on request, for callers who want many small mazes without starting a process for each
+// a request is one json object on a line of its own, and every request is answered with one line of json
+// every thread of the pool works on its own request, and keeps its maze and image between requests so their buffers are reused
+class maze_server
+{
+public:
+    // requests longer than this are refused
+    static constexpr std::size_t max_request_len = 1 << 20;
+
+    explicit maze_server(thread_pool &pool);
+
+    /// @brief answers requests read from in until it ends or a shutdown request comes
+    /// @param in stream of requests
+    /// @param out stream the responses are written to, in the order they finish
+    void serve(std::istream &in, std::ostream &out);
+
+    /// @brief listens on a unix socket, and answers requests from every connection on that connection until a shutdown request comes
+    /// @param path path of the socket, a socket that's already there is replaced
+    /// throws std::runtime_error if the socket can't be made, or unix sockets aren't supported on this platform
+    void serve_socket(const std::string &path);
+
+    // true if serve_socket can be used on this platform
+    static bool socket_supported();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct job
+    {
+        json_value request;
+        // writes a line of response back to whoever sent the request, safe from any thread
+        std::function<void(const std::string &)> respond;
+        clock::time_point received;
+    };
+
+    thread_pool &m_pool;
+
+    std::mutex m_lock;
+    std::condition_variable m_ready;
+    std::deque<job> m_jobs;
+    // no more jobs will be pushed
+    bool m_closed;
+
+    // parses line into a job and queues it, false if it was a shutdown request, which closes the queue
+    bool push(const std::string &line, std::function<void(const std::string &)> respond);
+    // false once the queue is closed and empty
+    bool pop(job &j);
+    void close();
+
+    // takes jobs off the queue until it's closed and empty, from every thread of the pool
+    void work();
+};
@@ -0,0 +1,208 @@
+#include "stats.h"
+#include "json.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+	#define MKMZ_WINDOWS_USAGE 1
+	#define NOMINMAX
+	#include <windows.h>
+	#include <psapi.h>
+#elif defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+	#define MKMZ_RUSAGE 1
+	#include <sys/resource.h>
+#endif
+
+namespace
+{
+	// bytes handed out by operator new since the program started
+	std::atomic<std::uint64_t> allocated{0};
+
+	const auto start = std::chrono::steady_clock::now();
+
+	void *allocate(std::size_t bytes)
+	{
+		allocated.fetch_add(bytes, std::memory_order_relaxed);
+		if (void *p = std::malloc(bytes ? bytes : 1))
+			return p;
+		throw std::bad_alloc();
+	}
+
+	void *allocate(std::size_t bytes, std::align_val_t alignment)
+	{
+		allocated.fetch_add(bytes, std::memory_order_relaxed);
+		std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+		void *p = _aligned_malloc(bytes ? bytes : 1, align);
+#else
+		// aligned_alloc wants a multiple of the alignment
+		void *p = std::aligned_alloc(align, (bytes + align - 1) / align * align + (bytes ? 0 : align));
+#endif
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	void deallocate(void *p, std::align_val_t)
+	{
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+
+	std::string number(double value)
+	{
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.6g", value);
+		return buf;
+	}
+}
+
+// every allocation goes through these so bytes allocated can be counted per phase
+// the array and nothrow forms call these by default
+void *operator new(std::size_t bytes) { return allocate(bytes); }
+void *operator new(std::size_t bytes, std::align_val_t alignment) { return allocate(bytes, alignment); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+void operator delete(void *p, std::size_t, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+
+usage usage::now()
+{
+	usage res{};
+	res.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	res.allocated_bytes = allocated.load(std::memory_order_relaxed);
+
+#ifdef MKMZ_RUSAGE
+	rusage ru{};
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+	{
+		res.cpu_seconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	#ifdef __APPLE__
+		res.peak_rss_bytes = static_cast<std::uint64_t>(ru.ru_maxrss);
+	#else
+		// kilobytes everywhere else
+		res.peak_rss_bytes = static_cast<std::uint64_t>(ru.ru_maxrss) * 1024;
+	#endif
+	}
+#elif defined(MKMZ_WINDOWS_USAGE)
+	FILETIME creation, exit, kernel, user;
+	if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+	{
+		auto seconds = [](FILETIME t) { return ((static_cast<std::uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 1e7; };
+		res.cpu_seconds = seconds(kernel) + seconds(user);
+	}
+	PROCESS_MEMORY_COUNTERS counters{};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		res.peak_rss_bytes = counters.PeakWorkingSetSize;
+#endif
+
+	return res;
+}
+
+void run_stats::begin(const std::string &name)
+{
+	end();
+	m_phases.push_back({name, usage::now(), {}, {}});
+	m_running = true;
+}
+
+void run_stats::end()
+{
+	if (!m_running)
+		return;
+	m_phases.back().stop = usage::now();
+	m_running = false;
+}
+
+void run_stats::rate(const std::string &name, double amount)
+{
+	if (m_phases.empty())
+		throw std::runtime_error("No phase to add a rate to");
+	m_phases.back().rates.emplace_back(name, amount);
+}
+
+void run_stats::property(const std::string &key, const std::string &value)
+{
+	m_properties.emplace_back(key, json_quote(value));
+}
+
+void run_stats::property(const std::string &key, const char *value)
+{
+	m_properties.emplace_back(key, json_quote(value));
+}
+
+void run_stats::property(const std::string &key, bool value)
+{
+	m_properties.emplace_back(key, value ? "true" : "false");
+}
+
+void run_stats::property(const std::string &key, double value)
+{
+	m_properties.emplace_back(key, number(value));
+}
+
+void run_stats::property(const std::string &key, std::uint64_t value)
+{
+	m_properties.emplace_back(key, std::to_string(value));
+}
+
+void run_stats::property(const std::string &key, pt value)
+{
+	std::string json = "[";
+	json += std::to_string(value.x);
+	json += ", ";
+	json += std::to_string(value.y);
+	json += ']';
+	m_properties.emplace_back(key, std::move(json));
+}
+
+void run_stats::write(const std::string &name) const
+{
+	std::ofstream file(name);
+	if (!file)
+		throw std::runtime_error("Couldn't open " + name);
+
+	usage total = usage::now();
+
+	file << "{\n";
+	for (const auto &[key, value] : m_properties)
+		file << "  " << json_quote(key) << ": " << value << ",\n";
+
+	file << "  \"wall_seconds\": " << number(total.wall_seconds) << ",\n";
+	file << "  \"cpu_seconds\": " << number(total.cpu_seconds) << ",\n";
+	file << "  \"allocated_bytes\": " << total.allocated_bytes << ",\n";
+	file << "  \"peak_rss_bytes\": " << total.peak_rss_bytes << ",\n";
+
+	file << "  \"phases\": [";
+	for (std::size_t i = 0; i < m_phases.size(); ++i)
+	{
+		const phase &p = m_phases[i];
+		// a phase that never ended lasted until now
+		const usage &stop = m_running && i + 1 == m_phases.size() ? total : p.stop;
+		double wall = stop.wall_seconds - p.start.wall_seconds;
+
+		file << (i ? ",\n" : "\n") << "    {\"name\": " << json_quote(p.name);
+		file << ", \"wall_seconds\": " << number(wall);
+		file << ", \"cpu_seconds\": " << number(stop.cpu_seconds - p.start.cpu_seconds);
+		file << ", \"allocated_bytes\": " << stop.allocated_bytes - p.start.allocated_bytes;
+		// peak of the whole process by the end of the phase, so it only ever grows
+		file << ", \"peak_rss_bytes\": " << stop.peak_rss_bytes;
+		for (const auto &[rate, amount] : p.rates)
+			file << ", " << json_quote(rate) << ": " << number(wall > 0 ? amount / wall : 0);
+		file << '}';
+	}
+	file << "\n  ]\n";
+	file << "}\n";
+
+	if (!file)
+		throw std::runtime_error("Couldn't write " + name);
+}
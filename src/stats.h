@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "maze.h"
+
+// what the process has used so far
+struct usage
+{
+    double wall_seconds;
+    double cpu_seconds;
+    // total of every heap allocation, memory mapped buffers aren't counted
+    std::uint64_t allocated_bytes;
+    // 0 if the platform can't tell
+    std::uint64_t peak_rss_bytes;
+
+    static usage now();
+};
+
+// collects the cost of each phase of a run and the properties of the result, and writes them as json
+class run_stats
+{
+public:
+    inline run_stats() : m_phases{}, m_running{}, m_properties{} {}
+
+    // ends the current phase, if any, and starts timing a new one
+    void begin(const std::string &name);
+    // ends the current phase
+    void end();
+
+    /// @brief adds a rate to the phase that ended last
+    /// @param name name of the rate, usually what's counted followed by _per_second
+    /// @param amount amount done in the whole phase, divided by its wall time
+    void rate(const std::string &name, double amount);
+
+    void property(const std::string &key, const std::string &value);
+    void property(const std::string &key, const char *value);
+    void property(const std::string &key, bool value);
+    void property(const std::string &key, double value);
+    void property(const std::string &key, std::uint64_t value);
+    void property(const std::string &key, pt value);
+
+    // throws std::runtime_error if the file can't be written
+    void write(const std::string &name) const;
+
+private:
+    struct phase
+    {
+        std::string name;
+        usage start;
+        usage stop;
+        std::vector<std::pair<std::string, double>> rates;
+    };
+
+    std::vector<phase> m_phases;
+    bool m_running;
+
+    // keys with values that are already json
+    std::vector<std::pair<std::string, std::string>> m_properties;
+};
@@ -0,0 +1,164 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace
+{
+	// pool the calling thread works for and its index in it, only set on workers
+	thread_local const thread_pool *current_pool = nullptr;
+	thread_local unsigned int current_index = 0;
+}
+
+thread_pool::thread_pool(unsigned int thread_count) : m_queued{0}, m_stop{false}
+{
+	if (!thread_count)
+		thread_count = 1;
+
+	// the last queue is used by threads outside of the pool
+	for (unsigned int i = 0; i < thread_count; ++i)
+		m_queues.push_back(std::make_unique<queue>());
+
+	m_workers.reserve(thread_count - 1);
+	for (unsigned int i = 0; i + 1 < thread_count; ++i)
+		m_workers.emplace_back(&thread_pool::worker, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		const std::lock_guard lock(m_idle_lock);
+		m_stop = true;
+	}
+	m_idle.notify_all();
+	m_workers.clear();
+}
+
+bool thread_pool::take(std::size_t i, task &t)
+{
+	// own tasks newest first, they're the most likely to still be in cache
+	{
+		queue &q = *m_queues[i];
+		const std::lock_guard lock(q.lock);
+		if (!q.tasks.empty())
+		{
+			t = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			--m_queued;
+			return true;
+		}
+	}
+
+	// steal oldest first
+	for (std::size_t off = 1; off < m_queues.size(); ++off)
+	{
+		queue &q = *m_queues[(i + off) % m_queues.size()];
+		const std::lock_guard lock(q.lock);
+		if (!q.tasks.empty())
+		{
+			t = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			--m_queued;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void thread_pool::run(task &t)
+{
+	group &g = *t.owner;
+	try
+	{
+		t.fun();
+	}
+	catch (...)
+	{
+		const std::lock_guard lock(g.lock);
+		if (!g.error)
+			g.error = std::current_exception();
+	}
+
+	// the group may be destroyed as soon as the waiting thread sees it finish, so it isn't touched after the lock is released
+	const std::lock_guard lock(g.lock);
+	if (--g.remaining == 0)
+		g.done.notify_all();
+}
+
+unsigned int thread_pool::thread_index() const
+{
+	return current_pool == this ? current_index : size() - 1;
+}
+
+void thread_pool::worker(std::size_t i)
+{
+	current_pool = this;
+	current_index = static_cast<unsigned int>(i);
+
+	for (;;)
+	{
+		task t;
+		if (take(i, t))
+		{
+			run(t);
+			continue;
+		}
+
+		std::unique_lock lock(m_idle_lock);
+		m_idle.wait(lock, [this]() { return m_stop || m_queued; });
+		if (m_stop)
+			return;
+	}
+}
+
+void thread_pool::parallel_for(uint64_t begin, uint64_t end, uint64_t grain, const std::function<void(uint64_t, uint64_t)> &fun)
+{
+	if (begin >= end)
+		return;
+	if (!grain)
+		grain = 1;
+
+	uint64_t count = (end - begin + grain - 1) / grain;
+
+	// nothing to share
+	if (count == 1 || m_workers.empty())
+	{
+		for (uint64_t first = begin; first < end; first += std::min(grain, end - first))
+			fun(first, first + std::min(grain, end - first));
+		return;
+	}
+
+	group g;
+	g.remaining = count;
+
+	// deal the tasks out to every queue, workers rebalance them by stealing
+	for (uint64_t t = 0; t < count; ++t)
+	{
+		uint64_t first = begin + t * grain;
+		uint64_t last = first + std::min(grain, end - first);
+
+		queue &q = *m_queues[t % m_queues.size()];
+		const std::lock_guard lock(q.lock);
+		q.tasks.push_back({&g, [&fun, first, last]() { fun(first, last); }});
+		++m_queued;
+	}
+
+	{
+		const std::lock_guard lock(m_idle_lock);
+	}
+	m_idle.notify_all();
+
+	// help until every task is taken, then wait for the ones still running
+	std::size_t own = m_queues.size() - 1;
+	task t;
+	while (g.remaining && take(own, t))
+		run(t);
+
+	{
+		std::unique_lock lock(g.lock);
+		g.done.wait(lock, [&g]() { return g.remaining == 0; });
+	}
+
+	if (g.error)
+		std::rethrow_exception(g.error);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+// fixed set of worker threads that are reused for every parallel job
+// every worker has its own queue of tasks, workers that run out of tasks steal from the others
+class thread_pool
+{
+public:
+    // thread_count includes the thread that calls parallel_for, so a pool of 1 runs everything on the caller
+    explicit thread_pool(unsigned int thread_count = std::thread::hardware_concurrency());
+    ~thread_pool();
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    // number of threads that work on a job, including the caller
+    inline unsigned int size() const { return static_cast<unsigned int>(m_workers.size()) + 1; }
+
+    // index of the calling thread from 0 to size() - 1, every thread outside of the pool is size() - 1
+    unsigned int thread_index() const;
+
+    /// @brief runs fun on every range of at most grain indices in [begin, end), and waits for all of them to finish
+    /// @param begin first index
+    /// @param end one past the last index
+    /// @param grain number of indices in one task
+    /// @param fun function that takes the first index and one past the last index of its range
+    /// the calling thread works on tasks while it waits, so parallel_for may be called from inside a task
+    /// the first exception thrown by fun is rethrown once every task has finished
+    void parallel_for(uint64_t begin, uint64_t end, uint64_t grain, const std::function<void(uint64_t, uint64_t)> &fun);
+
+private:
+    // tasks of one parallel_for call
+    struct group
+    {
+        std::atomic<uint64_t> remaining;
+        std::exception_ptr error;
+        std::mutex lock;
+        std::condition_variable done;
+    };
+
+    struct task
+    {
+        group *owner;
+        std::function<void()> fun;
+    };
+
+    struct queue
+    {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    std::vector<std::unique_ptr<queue>> m_queues;
+    std::vector<std::jthread> m_workers;
+
+    // tasks that are queued but not yet taken
+    std::atomic<uint64_t> m_queued;
+    std::mutex m_idle_lock;
+    std::condition_variable m_idle;
+    bool m_stop;
+
+    // takes a task from queue i, or steals one from another queue
+    bool take(std::size_t i, task &t);
+    void run(task &t);
+    void worker(std::size_t i);
+};
@@ -0,0 +1,120 @@
+// checks that mkmz_render draws the same pixels mkmz_encode_png encodes, in the layout mkmz.h documents
+// run by ctest, exits with 1 and says what differs if anything does
+
+#include "mkmz.h"
+
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// pixel channel c of row y, read from rendered pixels as mkmz_image_format describes them
+static unsigned int rendered(const unsigned char *pixels, const mkmz_image_format *format, uint64_t x, uint64_t y, int c)
+{
+    const unsigned char *row = pixels + y * format->row_bytes;
+    if (format->depth == 1)
+        return (row[x / 8] >> (7 - x % 8)) & 1 ? 255 : 0;
+    return row[x * format->color_type + c];
+}
+
+static int check(const char *name, mkmz_algorithm algorithm, const mkmz_style *style, int expected_depth)
+{
+    mkmz_maze *maze = NULL;
+    mkmz_image_format format;
+    unsigned char *pixels = NULL, *decoded = NULL;
+    void *png = NULL;
+    size_t size;
+    png_image img;
+    uint32_t seed = 7;
+    int res = 1;
+
+    // odd sizes so rows end part way through a byte
+    if (mkmz_maze_create(37, 21, &maze) ||
+        mkmz_maze_generate(maze, algorithm, &seed) ||
+        mkmz_image_format_of(maze, style, &format))
+    {
+        printf("%s: %s\n", name, mkmz_last_error());
+        goto done;
+    }
+    if (format.depth != expected_depth)
+    {
+        printf("%s: depth %d, expected %d\n", name, format.depth, expected_depth);
+        goto done;
+    }
+
+    pixels = malloc(format.row_bytes * format.height);
+    if (!pixels || mkmz_render(maze, style, pixels, format.row_bytes) || mkmz_encode_png(maze, style, 5, &png, &size))
+    {
+        printf("%s: %s\n", name, mkmz_last_error());
+        goto done;
+    }
+
+    memset(&img, 0, sizeof(img));
+    img.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&img, png, size))
+    {
+        printf("%s: couldn't decode the png, %s\n", name, img.message);
+        goto done;
+    }
+    static const png_uint_32 formats[] = {0, PNG_FORMAT_GRAY, PNG_FORMAT_GA, PNG_FORMAT_RGB, PNG_FORMAT_RGBA};
+    img.format = formats[format.color_type];
+    decoded = malloc(PNG_IMAGE_SIZE(img));
+    if (!decoded || !png_image_finish_read(&img, NULL, decoded, 0, NULL))
+    {
+        printf("%s: couldn't decode the png, %s\n", name, img.message);
+        png_image_free(&img);
+        goto done;
+    }
+    if (img.width != format.width || img.height != format.height)
+    {
+        printf("%s: png is %ux%u, format is %llux%llu\n", name, img.width, img.height, (unsigned long long)format.width, (unsigned long long)format.height);
+        goto done;
+    }
+
+    for (uint64_t y = 0; y < format.height; ++y)
+        for (uint64_t x = 0; x < format.width; ++x)
+            for (int c = 0; c < (int)format.color_type; ++c)
+            {
+                unsigned int want = decoded[(y * format.width + x) * format.color_type + c];
+                unsigned int got = rendered(pixels, &format, x, y, c);
+                if (want != got)
+                {
+                    printf("%s: pixel (%llu, %llu) channel %d is %u, the png has %u\n", name, (unsigned long long)x, (unsigned long long)y, c, got, want);
+                    goto done;
+                }
+            }
+
+    printf("%s: ok\n", name);
+    res = 0;
+
+done:
+    free(decoded);
+    mkmz_free(png);
+    free(pixels);
+    mkmz_maze_destroy(maze);
+    return res;
+}
+
+int main(void)
+{
+    mkmz_style style;
+    int failed = 0;
+
+    mkmz_style_default(&style);
+    failed |= check("gray 1 bit", MKMZ_RECURSIVE_BACKTRACKER, &style, 1);
+
+    // white walls, and cells 3 pixels wide so cells straddle bytes
+    memset(style.wall_color, 255, 4);
+    memset(style.cell_color, 0, 3);
+    style.cell_width = 3;
+    style.wall_width = 2;
+    failed |= check("inverted gray 1 bit", MKMZ_KRUSKALS, &style, 1);
+
+    mkmz_style_default(&style);
+    style.cell_width = style.cell_height = 2;
+    style.wall_color[0] = 200;
+    style.cell_color[3] = 128;
+    failed |= check("rgba", MKMZ_WILSONS, &style, 8);
+
+    return failed;
+}